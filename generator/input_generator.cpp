@@ -47,7 +47,7 @@ std::vector<std::string> gen_random_strings(std::mt19937_64 &rand_gen, size_t el
   return result;
 }
 
-int gen_input(std::ostream &out, size_t buses_count, size_t stops_count, size_t route_size, size_t request_count_buses, size_t request_count_stops, size_t count_map) {
+int gen_input(std::ostream &out, size_t buses_count, size_t stops_count, size_t route_size, size_t request_count_buses, size_t request_count_stops, size_t count_map, bool binary) {
   constexpr std::string_view edge_chars{"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdfghijklmnopqrstuvwxyz123456789"};
   constexpr std::string_view inner_chars{"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdfghijklmnopqrstuvwxyz123456789 "};
   std::mt19937_64 rand_gen{static_cast<size_t>(std::time(nullptr))};
@@ -97,7 +97,7 @@ int gen_input(std::ostream &out, size_t buses_count, size_t stops_count, size_t
 
   for (auto& [stop, neighbors] : adjacent_stops) {
     for (json::Node& node : base_nodes) {
-      json::Dict node_dict = node.AsMap();
+      json::Dict node_dict = node.AsDict();
       if (node_dict.at("type"s).AsString() == "Stop"s && 
           node_dict.at("name"s).AsString() == stop) {
         json::Dict distance;
@@ -170,7 +170,11 @@ int gen_input(std::ostream &out, size_t buses_count, size_t stops_count, size_t
   json::Dict nodes_dict{{"base_requests"s, base_nodes},
                         {"stat_requests"s, stat_nodes}, 
                         {"render_settings", render_nodes}};
-  json::Print(json::Document{json::Node{nodes_dict}}, out);
+  if (binary) {
+    json::PrintBinary(json::Document{json::Node{nodes_dict}}, out);
+  } else {
+    json::Print(json::Document{json::Node{nodes_dict}}, out);
+  }
 
   return 0;
 }
@@ -186,9 +190,11 @@ int main(int argc, char *argv[]) {
   const size_t request_count_buses = std::stoul(argv[4]);
   const size_t request_count_stops = std::stoul(argv[5]);
   const size_t count_map = std::stoul(argv[6]);
-  if (argc > 6) {
-    std::ofstream input_file{argv[7]};
-    return gen_input(input_file, buses_count, stops_count, route_size, request_count_buses, request_count_stops, count_map);
+  // Восьмой параметр "binary" включает вывод в CBOR
+  const bool binary = argc > 8 && argv[8] == "binary"sv;
+  if (argc > 7) {
+    std::ofstream input_file{argv[7], std::ios::binary};
+    return gen_input(input_file, buses_count, stops_count, route_size, request_count_buses, request_count_stops, count_map, binary);
   }
-  return gen_input(std::cout, buses_count, stops_count, route_size, request_count_buses, request_count_stops, count_map);
+  return gen_input(std::cout, buses_count, stops_count, route_size, request_count_buses, request_count_stops, count_map, binary);
 }
\ No newline at end of file
@@ -1,20 +1,103 @@
 #pragma once
 
-#include <set>
-#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string_view>
 #include <vector>
 
 #include "geo.h"
 
+// Остановки и маршруты нумеруются подряд с нуля в порядке добавления.
+// Имена указывают в пул каталога и нужны только для поиска и вывода,
+// внутри каталог работает с номерами
+using StopId = uint32_t;
+using BusId = uint32_t;
+
+// Остановки маршрута в порядке проезда. Некольцевой маршрут хранится
+// только в прямом направлении, обратный путь получается проходом назад
+class RouteView {
+ public:
+  class Iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = StopId;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const StopId*;
+    using reference = StopId;
+
+    Iterator(const RouteView& route, size_t index)
+        : route_(&route), index_(index) {}
+
+    StopId operator*() const { return (*route_)[index_]; }
+    Iterator& operator++() {
+      ++index_;
+      return *this;
+    }
+    bool operator==(const Iterator& other) const {
+      return index_ == other.index_;
+    }
+    bool operator!=(const Iterator& other) const {
+      return index_ != other.index_;
+    }
+
+   private:
+    const RouteView* route_;
+    size_t index_;
+  };
+
+  RouteView(const StopId* begin, const StopId* end, bool is_roundtrip)
+      : stops_(begin), forward_size_(end - begin), is_roundtrip_(is_roundtrip) {}
+
+  bool IsRoundtrip() const { return is_roundtrip_; }
+  // Число остановок в прямом направлении, последняя из них - конечная
+  size_t ForwardSize() const { return forward_size_; }
+
+  size_t size() const {
+    return is_roundtrip_ || forward_size_ == 0 ? forward_size_
+                                               : 2 * forward_size_ - 1;
+  }
+  bool empty() const { return forward_size_ == 0; }
+  StopId operator[](size_t index) const {
+    return index < forward_size_ ? stops_[index]
+                                 : stops_[2 * (forward_size_ - 1) - index];
+  }
+  StopId front() const { return stops_[0]; }
+  StopId back() const { return (*this)[size() - 1]; }
+
+  Iterator begin() const { return Iterator(*this, 0); }
+  Iterator end() const { return Iterator(*this, size()); }
+
+ private:
+  const StopId* stops_;
+  size_t forward_size_;
+  bool is_roundtrip_;
+};
+
 struct Bus {
+  BusId id = 0;
+  std::string_view name;
   int stopsOnRoute = 0;
   int uniqueStops = 0;
   double routeLength = 0;
   double curvature = 0;
-  std::vector<std::string> stops;
+  bool isRoundtrip = true;
+  // Удалённый маршрут сохраняет номер, но не ищется по имени
+  bool removed = false;
+  // Только прямое направление, полный проезд даёт Route
+  std::vector<StopId> stops;
+
+  RouteView Route() const {
+    return RouteView(stops.data(), stops.data() + stops.size(), isRoundtrip);
+  }
 };
 
 struct Stop {
+  StopId id = 0;
+  std::string_view name;
   Coordinates coord;
-  std::set<std::string> buses;
+  // Удалённая остановка сохраняет номер, но не ищется по имени
+  bool removed = false;
+  // Маршруты через остановку, упорядоченные по названию
+  std::vector<BusId> buses;
 };
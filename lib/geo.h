@@ -1,6 +1,11 @@
 #pragma once
 #define _USE_MATH_DEFINES
 #include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// Радиус Земли в метрах
+inline const int EarthRadius = 6371000;
 
 struct Coordinates {
   Coordinates() = default;
@@ -13,3 +18,20 @@ struct Coordinates {
 };
 
 double ComputeDistance(Coordinates from, Coordinates to);
+
+// Точка с заранее посчитанными синусом и косинусом широты.
+// Долгота остаётся в градусах, чтобы расстояние получалось
+// в точности таким же, как у ComputeDistance
+struct GeoPoint {
+  GeoPoint() = default;
+  explicit GeoPoint(Coordinates coord);
+
+  double sin_lat = 0;
+  double cos_lat = 1;
+  double lng = 0;
+};
+
+// Длина пути через points[path[0]], points[path[1]], ...
+// Совпадает с суммой ComputeDistance по соседним точкам в том же порядке
+double ComputePathLength(const GeoPoint* points, const uint32_t* path,
+                         size_t count);
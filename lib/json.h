@@ -1,16 +1,131 @@
 #pragma once
 
+#include <cstdint>
 #include <iostream>
-#include <map>
+#include <algorithm>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <variant>
 #include <vector>
 
 namespace json {
 
 class Node;
-using Dict = std::map<std::string, Node>;
-using Array = std::vector<Node>;
+// Контейнеры берут память из std::pmr::memory_resource: по умолчанию из
+// кучи, а у документов, загруженных в арену, из этой арены
+using Array = std::pmr::vector<Node>;
+
+// Словарь с упорядоченными по возрастанию ключами, как у std::map, но
+// хранящий пары подряд в одном векторе. Небольшие словари просматриваются
+// линейно, в остальных ключ ищется двоичным поиском
+class Dict {
+public:
+    using key_type = std::string;
+    using mapped_type = Node;
+    using value_type = std::pair<std::string, Node>;
+    using allocator_type = std::pmr::polymorphic_allocator<value_type>;
+    using const_iterator = std::pmr::vector<value_type>::const_iterator;
+
+    // Как у std::map, ключ через итератор не изменить: иначе нарушится
+    // порядок, на который опирается поиск. Значение изменяемое
+    class iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = Dict::value_type;
+        using difference_type = std::ptrdiff_t;
+        using reference = std::pair<const std::string&, Node&>;
+        struct pointer {
+            reference item;
+            const reference* operator->() const {
+                return &item;
+            }
+        };
+
+        iterator() = default;
+
+        reference operator*() const;
+        pointer operator->() const {
+            return {**this};
+        }
+        iterator& operator++();
+        iterator operator++(int);
+        operator const_iterator() const;
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+    private:
+        friend class Dict;
+        using Base = std::pmr::vector<Dict::value_type>::iterator;
+
+        explicit iterator(Base it)
+            : it_(it) {
+        }
+
+        Base it_;
+    };
+
+    Dict() = default;
+    explicit Dict(const allocator_type& alloc);
+    Dict(std::initializer_list<value_type> items, const allocator_type& alloc = {});
+
+    // Повторяющиеся ключи отбрасываются, остаётся первый
+    template <typename InputIt>
+    Dict(InputIt first, InputIt last, const allocator_type& alloc = {});
+
+    iterator begin() {
+        return iterator{items_.begin()};
+    }
+    iterator end() {
+        return iterator{items_.end()};
+    }
+    const_iterator begin() const {
+        return items_.begin();
+    }
+    const_iterator end() const {
+        return items_.end();
+    }
+
+    size_t size() const {
+        return items_.size();
+    }
+    bool empty() const {
+        return items_.empty();
+    }
+
+    iterator find(std::string_view key);
+    const_iterator find(std::string_view key) const;
+    size_t count(std::string_view key) const;
+
+    Node& at(std::string_view key);
+    const Node& at(std::string_view key) const;
+
+    Node& operator[](std::string key);
+
+    std::pair<iterator, bool> emplace(std::string key, Node value);
+    std::pair<iterator, bool> insert(value_type item);
+
+    allocator_type get_allocator() const {
+        return items_.get_allocator();
+    }
+
+    bool operator==(const Dict& rhs) const;
+    bool operator!=(const Dict& rhs) const;
+
+private:
+    static constexpr size_t LINEAR_SEARCH_LIMIT = 8;
+
+    std::pmr::vector<value_type> items_;
+
+    // Первый элемент с ключом не меньше key
+    const_iterator LowerBound(std::string_view key) const;
+    void SortAndUnique();
+};
 
 class ParsingError : public std::runtime_error {
 public:
@@ -118,18 +233,138 @@ inline bool operator!=(const Node& lhs, const Node& rhs) {
     return !(lhs == rhs);
 }
 
+inline Dict::iterator::reference Dict::iterator::operator*() const {
+    return {it_->first, it_->second};
+}
+
+inline Dict::iterator& Dict::iterator::operator++() {
+    ++it_;
+    return *this;
+}
+
+inline Dict::iterator Dict::iterator::operator++(int) {
+    return iterator{it_++};
+}
+
+inline Dict::iterator::operator const_iterator() const {
+    return it_;
+}
+
+inline bool Dict::iterator::operator==(const iterator& rhs) const {
+    return it_ == rhs.it_;
+}
+
+inline bool Dict::iterator::operator!=(const iterator& rhs) const {
+    return it_ != rhs.it_;
+}
+
+inline Dict::Dict(const allocator_type& alloc)
+    : items_(alloc) {
+}
+
+inline Dict::Dict(std::initializer_list<value_type> items, const allocator_type& alloc)
+    : items_(items, alloc) {
+    SortAndUnique();
+}
+
+template <typename InputIt>
+Dict::Dict(InputIt first, InputIt last, const allocator_type& alloc)
+    : items_(first, last, alloc) {
+    SortAndUnique();
+}
+
+inline void Dict::SortAndUnique() {
+    auto by_key = [](const value_type& lhs, const value_type& rhs) {
+        return lhs.first < rhs.first;
+    };
+    if (!std::is_sorted(items_.begin(), items_.end(), by_key)) {
+        std::stable_sort(items_.begin(), items_.end(), by_key);
+    }
+    items_.erase(std::unique(items_.begin(), items_.end(),
+                             [](const value_type& lhs, const value_type& rhs) {
+                                 return lhs.first == rhs.first;
+                             }),
+                 items_.end());
+}
+
+inline Dict::const_iterator Dict::LowerBound(std::string_view key) const {
+    if (items_.size() <= LINEAR_SEARCH_LIMIT) {
+        auto it = items_.begin();
+        while (it != items_.end() && std::string_view{it->first} < key) {
+            ++it;
+        }
+        return it;
+    }
+    return std::lower_bound(items_.begin(), items_.end(), key,
+                            [](const value_type& item, std::string_view key) {
+                                return std::string_view{item.first} < key;
+                            });
+}
+
+inline Dict::const_iterator Dict::find(std::string_view key) const {
+    const auto it = LowerBound(key);
+    return it != items_.end() && it->first == key ? it : items_.end();
+}
+
+inline Dict::iterator Dict::find(std::string_view key) {
+    return iterator{items_.begin() + (std::as_const(*this).find(key) - items_.cbegin())};
+}
+
+inline size_t Dict::count(std::string_view key) const {
+    return find(key) != end() ? 1 : 0;
+}
+
+inline const Node& Dict::at(std::string_view key) const {
+    const auto it = find(key);
+    if (it == end()) {
+        throw std::out_of_range("Dict::at");
+    }
+    return it->second;
+}
+
+inline Node& Dict::at(std::string_view key) {
+    return const_cast<Node&>(std::as_const(*this).at(key));
+}
+
+inline std::pair<Dict::iterator, bool> Dict::emplace(std::string key, Node value) {
+    const auto pos = items_.begin() + (LowerBound(key) - items_.cbegin());
+    if (pos != items_.end() && pos->first == key) {
+        return {iterator{pos}, false};
+    }
+    return {iterator{items_.emplace(pos, std::move(key), std::move(value))}, true};
+}
+
+inline std::pair<Dict::iterator, bool> Dict::insert(value_type item) {
+    return emplace(std::move(item.first), std::move(item.second));
+}
+
+inline Node& Dict::operator[](std::string key) {
+    return emplace(std::move(key), Node{}).first->second;
+}
+
+inline bool Dict::operator==(const Dict& rhs) const {
+    return items_ == rhs.items_;
+}
+
+inline bool Dict::operator!=(const Dict& rhs) const {
+    return !(*this == rhs);
+}
+
+// Неизменяемый документ. Копии документа разделяют одно дерево
 class Document {
 public:
-    explicit Document(Node root)
-        : root_(std::move(root)) {
-    }
+    explicit Document(Node root);
+
+    // Документ, контейнеры которого размещены в arena. Арена живёт, пока
+    // жива последняя копия документа, и освобождается целиком
+    Document(Node root, std::unique_ptr<std::pmr::memory_resource> arena);
 
     const Node& GetRoot() const {
-        return root_;
+        return *root_;
     }
 
 private:
-    Node root_;
+    std::shared_ptr<const Node> root_;
 };
 
 inline bool operator==(const Document& lhs, const Document& rhs) {
@@ -140,8 +375,63 @@ inline bool operator!=(const Document& lhs, const Document& rhs) {
     return !(lhs == rhs);
 }
 
+// Получатель событий потокового разбора. Контейнеры сообщаются парами
+// Start/End, скалярные значения приходят в Value уже готовыми узлами.
+// Повторяющиеся ключи в этом режиме не проверяются
+class Handler {
+public:
+    virtual void StartDict() = 0;
+    virtual void Key(std::string key) = 0;
+    virtual void EndDict() = 0;
+    virtual void StartArray() = 0;
+    virtual void EndArray() = 0;
+    virtual void Value(Node value) = 0;
+
+protected:
+    ~Handler() = default;
+};
+
 Document Load(std::istream& input);
 
+// Разбирает документ прямо из непрерывного буфера, без промежуточного потока
+Document Load(std::string_view input);
+
+// Разбирает документ, размещая все массивы и словари в arena.
+// Строки короче внутреннего буфера std::string отдельной памяти не требуют
+Document Load(std::string_view input, std::unique_ptr<std::pmr::memory_resource> arena);
+
+// Отображает файл в память и разбирает его без копирования в буфер
+Document LoadFile(const std::string& path);
+
+// Разбирает документ, не строя дерево, и сообщает о его элементах handler
+void Parse(std::istream& input, Handler& handler);
+void Parse(std::string_view input, Handler& handler);
+
+// Двоичное представление документа в формате CBOR (RFC 8949).
+// Целые и дробные числа различаются и переживают запись и чтение без потерь.
+// Корневой массив или словарь начинается с байта 0x80..0xbf, тогда как
+// текстовый JSON начинается с ASCII или с метки порядка байтов 0xef:
+// по первому байту форматы можно различить, см. IsBinary
+Document LoadBinary(std::istream& input);
+Document LoadBinary(std::string_view input);
+void ParseBinary(std::istream& input, Handler& handler);
+void ParseBinary(std::string_view input, Handler& handler);
+void PrintBinary(const Document& doc, std::ostream& output);
+
+// Старшие три бита 100 и 101 - массив и словарь CBOR
+inline bool IsBinary(int first_byte) {
+    return first_byte >= 0x80 && first_byte < 0xc0;
+}
+
+struct PrintSettings {
+    // Без пробелов и переводов строк, для машинного чтения
+    bool compact = false;
+    // Дробные числа кратчайшей записью, которая читается обратно без потерь.
+    // По умолчанию печатаются 6 значащих цифр, как у std::ostream
+    bool exact_doubles = false;
+};
+
 void Print(const Document& doc, std::ostream& output);
+void Print(const Document& doc, std::ostream& output, const PrintSettings& settings);
 
 }  // namespace json
\ No newline at end of file
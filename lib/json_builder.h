@@ -1,7 +1,8 @@
+#pragma once
+
 #include <algorithm>
-#include <optional>
+#include <memory_resource>
 #include <string>
-#include <variant>
 #include <vector>
 
 #include "json.h"
@@ -12,28 +13,51 @@ class ArrayItemContext;
 class KeyItemContext;
 class DictItemContext;
 
+// Готовые значения копятся в общих стеках, как при разборе документа.
+// Контейнер создаётся один раз, когда известно число его элементов,
+// и получает элементы перемещением: узлы не выделяются по отдельности
 class Builder {
  public:
   Builder();
+  // Массивы и словари документа будут размещены в resource
+  explicit Builder(std::pmr::memory_resource* resource);
 
   DictItemContext StartDict();
   ArrayItemContext StartArray();
 
   Builder& Key(std::string str);
 
-  Builder& Value(json::Node node);
+  // Узел перемещается в родителя, повторный ключ заменяет прежнее значение.
+  // Копию lvalue-узла нужно сделать явно
+  Builder& Value(json::Node&& node);
 
   Builder& EndArray();
   Builder& EndDict();
 
+  // Отдаёт построенный узел. Вызывается один раз
   Node Build();
 
-  ~Builder();
-
  private:
+  // Запас под типичный ответ, чтобы стеки не росли по одному элементу
+  static constexpr size_t INITIAL_DEPTH = 4;
+  static constexpr size_t INITIAL_ITEMS = 16;
+
+  struct Frame {
+    bool is_dict;
+    // Начало элементов контейнера в items_ или values_
+    size_t first;
+    bool has_key = false;
+  };
+
+  std::pmr::memory_resource* resource_;
   json::Node root_;
-  std::vector<std::optional<std::string>> keys_;
-  std::vector<json::Node*> nodes_stack_;
+  bool done_ = false;
+  std::vector<Frame> frames_;
+  std::vector<Dict::value_type> items_;
+  std::vector<json::Node> values_;
+
+  void CheckValue() const;
+  void Place(json::Node&& node);
 };
 
 class DictItemContext {
@@ -52,7 +76,7 @@ class KeyItemContext {
  public:
   explicit KeyItemContext(Builder& builder);
 
-  DictItemContext Value(json::Node node);
+  DictItemContext Value(json::Node&& node);
 
   DictItemContext StartDict();
 
@@ -66,7 +90,7 @@ class ArrayItemContext {
  public:
   explicit ArrayItemContext(Builder& builder);
 
-  ArrayItemContext Value(json::Node node);
+  ArrayItemContext Value(json::Node&& node);
 
   DictItemContext StartDict();
 
@@ -2,31 +2,57 @@
 
 #include <istream>
 #include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
 
 #include "domain.h"
 #include "geo.h"
 #include "json.h"
 #include "map_renderer.h"
 #include "request_handler.h"
+#include "road_router.h"
 #include "json_builder.h"
+#include "json_stream_builder.h"
 
 class JsonReader {
  public:
   JsonReader(RequestHandler& handler, std::istream& input);
+  JsonReader(RequestHandler& handler, std::string_view input);
   void Print(std::ostream& output);
 
+  // Сохраняет снимок каталога с иерархией сжатий дорог и настройки
+  // отрисовки в файл из serialization_settings. Бросает
+  // std::runtime_error, если файл не удалось записать
+  void SaveBase();
+  // Заменяет снимок каталога загруженным из файла serialization_settings.
+  // Настройки отрисовки берутся из того же файла. Бросает
+  // std::runtime_error, если файла нет или он повреждён
+  void LoadBase();
+
  private:
+  class RequestsHandler;
+
   RequestHandler& handler_;
+  // Все разделы запроса, кроме base_requests: они обрабатываются
+  // по мере разбора и в документе не хранятся
   json::Document requests_;
 
   void EnterData(const json::Node& node);
-  void AddRoute(const json::Node& node_base_requests);
-  void AddDistance(const json::Node& node_base_requests);
-  void AddStop(const json::Node& node_base_requests);
+  const std::string& GetBaseFile() const;
+  void AddStop(const json::Dict& map_base_request);
 
   void SetRendererSettings(const json::Node& node_render_settings);
 
-  json::Document GetJsonAnswers();
-  json::Node GetNodeStop(const json::Dict& map_state_request);
-  json::Node GetNodeBus(const json::Dict& map_state_request);
+  void PrintStop(json::StreamBuilder& out, const json::Dict& map_state_request);
+  void PrintBus(json::StreamBuilder& out, const json::Dict& map_state_request);
+  void PrintMap(json::StreamBuilder& out, const json::Dict& map_state_request);
+  void PrintNearestStops(json::StreamBuilder& out,
+                         const json::Dict& map_state_request);
+  void PrintStopsInBox(json::StreamBuilder& out,
+                       const json::Dict& map_state_request);
+  void PrintDistance(json::StreamBuilder& out,
+                     const json::Dict& map_state_request,
+                     transport::RoadRouter& router);
+  void PrintNotFound(json::StreamBuilder& out, int request_id);
 };
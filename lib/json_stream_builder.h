@@ -0,0 +1,126 @@
+#pragma once
+
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+#include "json.h"
+#include "json_writer.h"
+
+namespace json {
+
+// Тот же интерфейс, что у Builder, но узлы не накапливаются: каждый вызов
+// сразу пишется в поток через Writer. Ключи выводятся в порядке вызовов,
+// поэтому для совпадения с печатью Document их нужно задавать по алфавиту
+class StreamBuilder {
+ public:
+  class DictContext;
+  class KeyContext;
+  class ArrayContext;
+
+  explicit StreamBuilder(std::ostream& output, PrintSettings settings = {});
+
+  DictContext StartDict();
+  ArrayContext StartArray();
+
+  StreamBuilder& Key(std::string_view key);
+
+  template <typename T>
+  StreamBuilder& Value(const T& value) {
+    BeforeValue();
+    writer_.Value(value);
+    AfterValue();
+    return *this;
+  }
+
+  StreamBuilder& EndDict();
+  StreamBuilder& EndArray();
+
+  // Дописывает буфер в поток. Корневое значение должно быть завершено
+  void Finish();
+
+ private:
+  struct Level {
+    bool is_dict;
+    bool has_key = false;
+  };
+
+  Writer writer_;
+  std::vector<Level> levels_;
+  bool done_ = false;
+
+  void BeforeValue();
+  void AfterValue();
+};
+
+class StreamBuilder::DictContext {
+ public:
+  explicit DictContext(StreamBuilder& builder) : builder_(builder) {}
+
+  KeyContext Key(std::string_view key);
+
+  StreamBuilder& EndDict() {
+    return builder_.EndDict();
+  }
+
+ private:
+  StreamBuilder& builder_;
+};
+
+class StreamBuilder::KeyContext {
+ public:
+  explicit KeyContext(StreamBuilder& builder) : builder_(builder) {}
+
+  template <typename T>
+  DictContext Value(const T& value) {
+    builder_.Value(value);
+    return DictContext{builder_};
+  }
+
+  DictContext StartDict() {
+    return builder_.StartDict();
+  }
+
+  ArrayContext StartArray();
+
+ private:
+  StreamBuilder& builder_;
+};
+
+class StreamBuilder::ArrayContext {
+ public:
+  explicit ArrayContext(StreamBuilder& builder) : builder_(builder) {}
+
+  template <typename T>
+  ArrayContext Value(const T& value) {
+    builder_.Value(value);
+    return *this;
+  }
+
+  DictContext StartDict() {
+    return builder_.StartDict();
+  }
+
+  ArrayContext StartArray() {
+    return builder_.StartArray();
+  }
+
+  StreamBuilder& EndArray() {
+    return builder_.EndArray();
+  }
+
+ private:
+  StreamBuilder& builder_;
+};
+
+inline StreamBuilder::KeyContext StreamBuilder::DictContext::Key(
+    std::string_view key) {
+  builder_.Key(key);
+  return KeyContext{builder_};
+}
+
+inline StreamBuilder::ArrayContext StreamBuilder::KeyContext::StartArray() {
+  return builder_.StartArray();
+}
+
+}  // namespace json
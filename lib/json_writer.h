@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "json.h"
+
+namespace json {
+
+// Форматирует JSON в собственный буфер и сбрасывает его в поток крупными
+// кусками. Значения подаются событиями, как в Builder, либо целыми узлами.
+// Разметка по умолчанию совпадает с прежней печатью через std::ostream
+class Writer {
+public:
+    explicit Writer(std::ostream& output, PrintSettings settings = {});
+
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    ~Writer();
+
+    void StartDict();
+    void Key(std::string_view key);
+    void EndDict();
+
+    void StartArray();
+    void EndArray();
+
+    void Value(const Node& node);
+    void Value(std::nullptr_t);
+    void Value(bool value);
+    void Value(int value);
+    // Целые больше int, которых нет среди значений Node
+    void Value(uint64_t value);
+    void Value(double value);
+    void Value(std::string_view value);
+    void Value(const std::string& value) {
+        Value(std::string_view{value});
+    }
+    void Value(const char* value) {
+        Value(std::string_view{value});
+    }
+
+    // Отдаёт накопленное в поток
+    void Flush();
+
+private:
+    struct Level {
+        bool is_dict;
+        size_t count = 0;
+    };
+
+    std::ostream& output_;
+    PrintSettings settings_;
+    std::string buffer_;
+    std::vector<Level> levels_;
+
+    void BeforeValue();
+    void NextItem();
+    void Close(char bracket);
+    void WriteIndent(size_t indent);
+    void WriteString(std::string_view value);
+    void FlushIfFull();
+};
+
+}  // namespace json
@@ -5,11 +5,13 @@
 #include <optional>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "domain.h"
 #include "geo.h"
 #include "svg.h"
+#include "transport_snapshot.h"
 
 namespace renderer {
 
@@ -85,42 +87,33 @@ class SphereProjector {
   double zoom_coeff_ = 0;
 };
 
-struct Route {
-  std::string first_stop;
-  std::string last_stop;
-  Bus* bus;
-  bool is_round;
-};
-
 class MapRenderer {
  public:
-  svg::Document RenderMap();
+  // Маршруты, остановки и координаты берутся из снимка каталога
+  svg::Document RenderMap(const transport::Snapshot& snapshot);
 
   void SetRendererSettings(const RenderSettings& settings);
-  void SetRoute(const std::string& number, Route&& route);
-  void SetCoordinates(const std::string& name, Stop* stop_ptr);
 
  private:
   RenderSettings settings_;
-  std::map<std::string, Route> bus_ptrs_;
-  std::map<std::string, Stop*> stop_ptrs_;
 
   void RenderLinesBetweenStops(svg::Document& doc,
+                               const transport::Snapshot& snapshot,
                                const SphereProjector& sphere_projector);
   void RenderRouteNames(svg::Document& doc,
+                        const transport::Snapshot& snapshot,
                         const SphereProjector& sphere_projector);
   void RenderStopSymbol(svg::Document& doc,
+                        const transport::Snapshot& snapshot,
                         const SphereProjector& sphere_projector);
   void RenderStopNames(svg::Document& doc,
+                       const transport::Snapshot& snapshot,
                        const SphereProjector& sphere_projector);
 
   void SetDefaultSettingsRouteName(svg::Text& text_underlay, svg::Text& text);
   void SetDefaultSettingsStopName(svg::Text& text_underlay, svg::Text& text);
   void SetColor(svg::Text& text, std::vector<svg::Color>::iterator& iter_color);
-  void SetName(svg::Text& text, const std::string& name);
-  void SetPositionStop(svg::Text& text,
-                       const std::string& stop,
-                       const SphereProjector& sphere_projector);
+  void SetName(svg::Text& text, std::string_view name);
   void SetPositionStop(svg::Text& text,
                        const Coordinates coord,
                        const SphereProjector& sphere_projector);
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Файл, отображённый в память только для чтения.
+// Содержимое доступно, пока жив объект.
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string& path);
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  ~MappedFile();
+
+  std::string_view GetData() const;
+
+ private:
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+};
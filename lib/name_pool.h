@@ -0,0 +1,32 @@
+#pragma once
+
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace transport {
+
+// Хранилище имён, в которое можно только дописывать. Имена лежат подряд
+// в крупных блоках, блоки никогда не перемещаются, поэтому выданные
+// string_view остаются верными, пока жив пул
+class NamePool {
+ public:
+  std::string_view Add(std::string_view name);
+
+  // Занято байт под имена
+  size_t Size() const { return size_; }
+
+ private:
+  // Блоки растут вдвое, чтобы маленький каталог не занимал лишнего
+  static constexpr size_t MIN_BLOCK_SIZE = 1024;
+  static constexpr size_t MAX_BLOCK_SIZE = 64 * 1024;
+
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  // Свободное место в последнем блоке
+  char* free_ = nullptr;
+  size_t free_size_ = 0;
+  size_t next_block_size_ = MIN_BLOCK_SIZE;
+  size_t size_ = 0;
+};
+
+}  // namespace transport
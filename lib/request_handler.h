@@ -1,36 +1,54 @@
 #pragma once
 
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "domain.h"
 #include "geo.h"
 #include "map_renderer.h"
+#include "snapshot_versions.h"
 #include "svg.h"
 #include "transport_catalogue.h"
+#include "transport_snapshot.h"
 
 class RequestHandler {
  public:
   RequestHandler(transport::Catalogue& tc, renderer::MapRenderer& renderer);
 
-  void AddRoute(const std::string& number,
+  void AddRoute(std::string_view number,
                 std::vector<std::string>&& stops,
                 bool is_round);
 
-  void AddStop(const std::string& name, Coordinates coord);
+  void AddStop(std::string_view name, Coordinates coord);
 
-  void SetDistance(const std::pair<std::string, std::string>& stops,
+  void SetDistance(std::string_view from, std::string_view to,
                    uint32_t distance);
 
   void SetRendererSettings(renderer::RenderSettings& settings);
 
-  Bus* GetBusData(const std::string& number);
+  Bus* GetBusData(std::string_view number);
 
-  Stop* GetStopData(const std::string& name);
+  Stop* GetStopData(std::string_view name);
+
+  // Фиксирует каталог и публикует снимок новой версией. Запросы
+  // статистики и карта дальше обслуживаются неизменяемым снимком
+  void Freeze();
+
+  // Обслуживать запросы готовым снимком, например загруженным из файла
+  void SetSnapshot(std::shared_ptr<const transport::Snapshot> snapshot);
+
+  // Доступен после Freeze или SetSnapshot. Ссылка верна до следующей
+  // публикации, другим потокам нужно закреплять версию через GetVersions
+  const transport::Snapshot& GetSnapshot() const;
+
+  transport::SnapshotVersions& GetVersions() { return versions_; }
 
   svg::Document RenderMap() const;
 
  private:
   transport::Catalogue& tc_;
   renderer::MapRenderer& renderer_;
+  transport::SnapshotVersions versions_;
 };
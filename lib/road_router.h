@@ -0,0 +1,101 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "domain.h"
+#include "transport_snapshot.h"
+
+namespace transport {
+
+// Строит иерархию сжатий по дорожному графу в формате CSR. Остановки
+// сжимаются по одной, начиная с наименее важных; если кратчайший путь
+// между соседями проходил через сжатую остановку, между ними добавляется
+// срезка. Важность - сколько срезок добавится сверх удалённых рёбер,
+// сколько соседей уже сжато и на какой глубине. Слишком связные
+// остановки не сжимаются и остаются в ядре
+Snapshot::Hierarchy ContractRoads(const Snapshot& snapshot);
+
+// Кратчайшие пути по дорогам между любыми остановками снимка.
+// Поиск идёт с обоих концов вверх по иерархии до ядра и встречается
+// в самой важной остановке пути, а в ядре продолжается обычным
+// двунаправленным поиском. Хранит буферы поиска, поэтому каждому
+// потоку нужен свой объект
+class RoadRouter {
+ public:
+  struct Route {
+    uint64_t distance = 0;
+    // Все остановки пути, включая концы
+    std::vector<StopId> stops;
+  };
+
+  // Берёт иерархию из снимка, а если её там нет, строит по дорогам
+  // снимка и хранит у себя
+  explicit RoadRouter(const Snapshot& snapshot);
+  // Иерархия, построенная ContractRoads по этому снимку, должна
+  // пережить объект. Так потоки делят одну иерархию
+  RoadRouter(const Snapshot& snapshot, RoadHierarchy hierarchy)
+      : snapshot_(snapshot), hierarchy_(hierarchy) {}
+
+  RoadRouter(const RoadRouter&) = delete;
+  RoadRouter& operator=(const RoadRouter&) = delete;
+
+  // nullopt, если дорог от from до to нет
+  std::optional<Route> FindRoute(StopId from, StopId to);
+
+ private:
+  static constexpr uint64_t INFINITE = UINT64_MAX;
+  // Прямой поиск идёт по рёбрам вверх, обратный - по рёбрам вниз
+  // от конца к началу
+  static constexpr size_t FORWARD = 0;
+  static constexpr size_t BACKWARD = 1;
+
+  // Остановки здесь - номера в иерархии
+  struct Label {
+    uint64_t distance;
+    // Эпоха запроса, в котором остановка достигнута. Отметки эпохой
+    // избавляют от очистки массивов между запросами
+    uint32_t mark;
+    // Начало ребра, по которому остановка достигнута
+    uint32_t parent;
+  };
+
+  const Snapshot& snapshot_;
+  Snapshot::Hierarchy built_;
+  RoadHierarchy hierarchy_;
+  // Метки обеих сторон лежат рядом: встреча проверяется без лишнего
+  // промаха кэша
+  std::vector<std::array<Label, 2>> labels_;
+  // Кучи по расстоянию, сверху ближайшая
+  std::vector<std::pair<uint64_t, uint32_t>> queues_[2];
+  // Остановки ядра, до которых дошёл подъём
+  std::vector<uint32_t> entries_[2];
+  uint32_t epoch_ = 0;
+  // Лучший найденный путь проходит через meeting_
+  uint64_t best_ = INFINITE;
+  uint32_t meeting_ = 0;
+
+  bool Reached(size_t side, uint32_t stop) const {
+    return labels_[stop][side].mark == epoch_;
+  }
+  uint64_t Front(size_t side) const {
+    return queues_[side].empty() ? INFINITE : queues_[side].front().first;
+  }
+  Span<HierarchyEdge> Edges(size_t side, uint32_t stop) const {
+    return side == FORWARD ? hierarchy_.UpwardEdges(stop)
+                           : hierarchy_.DownwardEdges(stop);
+  }
+
+  void Climb();
+  bool IsStalled(size_t side, uint32_t stop, uint64_t distance) const;
+  void SearchCore();
+  void Relax(size_t side, uint32_t from, uint64_t distance, bool in_core);
+  void Reach(size_t side, uint32_t stop, uint64_t distance, uint32_t parent);
+  void Unpack(uint32_t from, uint32_t to, uint32_t via,
+              std::vector<StopId>& stops) const;
+};
+
+}  // namespace transport
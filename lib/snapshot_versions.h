@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "transport_snapshot.h"
+
+namespace transport {
+
+// Версии снимка для одновременного чтения и обновления (RCU на эпохах).
+// Писатель публикует новую версию, читатели закрепляют текущую без
+// блокировок и счётчиков ссылок: объявляют эпоху в своём слоте и берут
+// указатель. Заменённая версия освобождается, когда ни один читатель
+// не объявил эпоху, в которой она могла быть текущей
+class SnapshotVersions {
+ public:
+  // Закреплённая версия. Пока объект жив, снимок не освобождается.
+  // Живёт в потоке своего читателя и не должен его переживать
+  class Pin {
+   public:
+    Pin(const Pin&) = delete;
+    Pin& operator=(const Pin&) = delete;
+    Pin(Pin&& other) noexcept;
+    ~Pin();
+
+    const Snapshot& operator*() const { return *snapshot_; }
+    const Snapshot* operator->() const { return snapshot_; }
+
+   private:
+    friend class SnapshotVersions;
+
+    std::atomic<uint64_t>* epoch_ = nullptr;
+    const Snapshot* snapshot_ = nullptr;
+
+    Pin(std::atomic<uint64_t>* epoch, const Snapshot* snapshot)
+        : epoch_(epoch), snapshot_(snapshot) {}
+  };
+
+  // Число читателей ограничено заранее, чтобы слоты не перемещались
+  explicit SnapshotVersions(size_t max_readers = 64);
+
+  SnapshotVersions(const SnapshotVersions&) = delete;
+  SnapshotVersions& operator=(const SnapshotVersions&) = delete;
+
+  // Выдаёт свободный слот читателю. Поток-читатель держит свой слот, пока
+  // читает, и в один момент держит не больше одного Pin. Бросает
+  // std::length_error, если все слоты заняты
+  size_t RegisterReader();
+  // Возвращает слот для следующих читателей. Pin этого слота
+  // должен быть уже разрушен
+  void UnregisterReader(size_t reader);
+
+  // Путь чтения: два атомарных чтения и одна запись в собственный слот.
+  // Версия должна быть опубликована
+  Pin Acquire(size_t reader) const;
+
+  // Путь записи. Писатели упорядочиваются между собой мьютексом.
+  // Прежняя версия уходит в список ожидающих освобождения
+  void Publish(std::shared_ptr<const Snapshot> snapshot);
+
+  // Текущая версия для писателя, читателям нужен Acquire
+  const Snapshot* Current() const {
+    return current_.load(std::memory_order_acquire);
+  }
+
+  // Освобождает версии, которые больше никто не может читать.
+  // Вызывается и из Publish. Возвращает число оставшихся в ожидании
+  size_t Reclaim();
+
+ private:
+  static constexpr uint64_t IDLE = UINT64_MAX;
+
+  // Слоты на разных строках кэша, чтобы читатели не мешали друг другу
+  struct alignas(64) ReaderSlot {
+    std::atomic<uint64_t> epoch{IDLE};
+    std::atomic<bool> used{false};
+  };
+
+  struct Retired {
+    std::shared_ptr<const Snapshot> snapshot;
+    // Читатели, объявившие эпоху не меньше этой, версию уже не видят
+    uint64_t epoch;
+  };
+
+  std::unique_ptr<ReaderSlot[]> readers_;
+  size_t max_readers_;
+  // Слоты с номерами от этого и дальше ещё ни разу не выдавались
+  std::atomic<size_t> reader_count_{0};
+
+  std::atomic<uint64_t> epoch_{0};
+  std::atomic<const Snapshot*> current_{nullptr};
+
+  std::mutex writer_mutex_;
+  // Владеет текущей версией
+  std::shared_ptr<const Snapshot> owner_;
+  std::vector<Retired> retired_;
+
+  size_t ReclaimLocked();
+};
+
+}  // namespace transport
@@ -2,55 +2,148 @@
 
 #include <deque>
 #include <iomanip>
-#include <set>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
 #include "domain.h"
+#include "name_pool.h"
+#include "transport_snapshot.h"
 
 namespace transport {
 
+// Данные можно добавлять в любом порядке: маршрут и расстояние могут
+// упоминать остановку раньше, чем она добавлена. Такие имена запоминаются
+// и разрешаются пакетом в Finalize, там же считается статистика маршрутов.
+// Изменения уже добавленных данных помечают затронутые маршруты,
+// и Finalize пересчитывает только их
 class Catalogue {
  public:
-  void AddRoute(const std::string& number,
-                std::vector<std::string>&& stops);
+  // Маршрут сразу получает идентификатор, а его остановки
+  // и статистика появятся после Finalize. У некольцевого маршрута
+  // передаётся только прямое направление
+  void AddRoute(std::string_view number, std::vector<std::string>&& stops,
+                bool is_roundtrip = true);
 
-  void AddStop(const std::string& name, Coordinates coord);
+  // Повторное добавление остановки с тем же именем ничего не меняет
+  StopId AddStop(std::string_view name, Coordinates coord);
 
-  Bus* FindRoute(const std::string& number);
+  // Поиск по имени ничего не выделяет: словари имён хранят string_view
+  Bus* FindRoute(std::string_view number);
 
-  Stop* FindStop(const std::string& stop);
+  Stop* FindStop(std::string_view stop);
 
-  Bus* GetBusData(const std::string& number);
+  Bus* GetBusData(std::string_view number);
 
-  Stop* GetStopData(const std::string& name);
+  Stop* GetStopData(std::string_view name);
 
-  void SetDistance(const std::pair<std::string, std::string>& stops,
+  const Bus& GetBus(BusId id) const;
+
+  const Stop& GetStop(StopId id) const;
+
+  // Расстояние, в котором к Finalize так и не появилась
+  // одна из остановок, отбрасывается
+  void SetDistance(std::string_view from, std::string_view to,
                    uint32_t distance);
 
-  uint32_t GetDistance(const std::pair<std::string, std::string>& stops);
+  void SetDistance(StopId from, StopId to, uint32_t distance);
+
+  // Если расстояние задано только в обратную сторону, берётся оно.
+  // Для незаданной пары возвращается 0.
+  // После новых SetDistance первый вызов перестраивает таблицу расстояний
+  uint32_t GetDistance(StopId from, StopId to) const;
+
+  // Методы изменения бросают std::invalid_argument для неизвестных имён.
+  // Удалённые остановки и маршруты сохраняют свои номера
+  void UpdateStop(std::string_view name, Coordinates coord);
+  // Остановка исключается из всех маршрутов вместе с расстояниями до неё.
+  // Маршруты, от которых осталась одна остановка, удаляются
+  void RemoveStop(std::string_view name);
+  void UpdateDistance(std::string_view from, std::string_view to,
+                      uint32_t distance);
+  // Остановки нового пути разрешаются в Finalize, как у AddRoute
+  void UpdateRoute(std::string_view number, std::vector<std::string>&& stops,
+                   bool is_roundtrip);
+  void RemoveRoute(std::string_view number);
+
+  // Разрешает отложенные имена, заполняет списки маршрутов у остановок
+  // и считает статистику новых и изменённых маршрутов в thread_count потоков.
+  // Бросает std::invalid_argument, если маршрут проходит через
+  // так и не добавленную остановку
+  void Finalize(unsigned thread_count = std::thread::hardware_concurrency());
+
+  // Вызывает Finalize и собирает неизменяемый снимок для ответов
+  // на запросы. Каталог после этого можно менять дальше,
+  // снимок это не затронет
+  std::shared_ptr<const Snapshot> Freeze();
 
  private:
-  struct PairHasher {
-    size_t operator()(const std::pair<Stop*, Stop*>& stops) const {
-      return hasher_(stops.first) + hasher_(stops.second) * 37;
-    }
+  struct Road {
+    StopId from;
+    StopId to;
+    uint32_t distance;
+  };
+
+  struct PendingRoad {
+    std::string from;
+    std::string to;
+    uint32_t distance;
+  };
+
+  struct PendingRoute {
+    BusId bus;
+    std::vector<std::string> stops;
+  };
 
-   private:
-    std::hash<const void*> hasher_;
+  // Остановка уже встречалась в текущем маршруте,
+  // если её отметка равна номеру прохода
+  struct StopMarks {
+    std::vector<uint32_t> marks;
+    uint32_t epoch = 0;
   };
 
+  // Меньше маршрутов на поток не окупают его запуск
+  static constexpr size_t MIN_BUSES_PER_THREAD = 256;
+
+  // Номер элемента в deque совпадает с его идентификатором.
+  // Имена элементов и ключи словарей указывают в пул
+  NamePool names_;
   std::deque<Bus> buses_;
   std::deque<Stop> stops_;
-  std::unordered_map<std::string, Bus*> busesPtr_;
-  std::unordered_map<std::string, Stop*> stopsPtr_;
-  std::unordered_map<std::pair<Stop*, Stop*>, uint32_t, PairHasher>
-      distanceBetweenStops_;
-
-  void SetLengthAndCurvature(Bus& bus, const std::vector<std::string>& stops);
-  void SetNumberStopsAndUniqueStops(Bus& bus, const std::vector<std::string>& stops);
-  void AddRouteToStops(const std::string& number, const std::vector<std::string>& stops);
+  // Тригонометрия широт остановок, по номеру остановки
+  std::vector<GeoPoint> geoPoints_;
+  std::unordered_map<std::string_view, BusId> busIds_;
+  std::unordered_map<std::string_view, StopId> stopIds_;
+  // Расстояния в порядке задания
+  std::vector<Road> roads_;
+  // Ждут Finalize
+  std::vector<PendingRoad> pendingRoads_;
+  std::vector<PendingRoute> pendingRoutes_;
+  // Маршруты, статистику которых пересчитает Finalize
+  std::vector<BusId> changedBuses_;
+
+  // Таблица расстояний в формате CSR: соседи остановки stop с расстояниями
+  // до них лежат в roadTargets_ с индекса roadOffsets_[stop]
+  // до roadOffsets_[stop + 1], соседи по возрастанию.
+  // Обратные направления, заданные только в одну сторону, уже добавлены
+  mutable std::vector<uint32_t> roadOffsets_;
+  mutable std::vector<RoadTarget> roadTargets_;
+  mutable bool roadsChanged_ = false;
+
+  void BuildRoads() const;
+
+  void SetLengthAndCurvature(Bus& bus, std::vector<StopId>& path);
+  void SetNumberStopsAndUniqueStops(Bus& bus, StopMarks& marks);
+  void AddRoutesToStops(const std::vector<BusId>& buses);
+  void RemoveRouteFromStops(const Bus& bus);
+  void DropRoute(Bus& bus);
+  void MarkStopBuses(StopId stop);
+  void ComputeBusStats(const std::vector<BusId>& buses, unsigned thread_count);
+  Stop& GetLiveStop(std::string_view name);
+  Bus& GetLiveBus(std::string_view number);
 };
 
 }  // namespace transport
@@ -0,0 +1,379 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "domain.h"
+#include "geo.h"
+
+namespace transport {
+
+// Непрерывный отрезок элементов, которыми владеет кто-то другой
+template <typename T>
+class Span {
+ public:
+  Span() = default;
+  Span(const T* begin, const T* end) : begin_(begin), end_(end) {}
+  Span(const std::vector<T>& items)
+      : begin_(items.data()), end_(items.data() + items.size()) {}
+
+  const T* begin() const { return begin_; }
+  const T* end() const { return end_; }
+  size_t size() const { return end_ - begin_; }
+  bool empty() const { return begin_ == end_; }
+  const T& front() const { return *begin_; }
+  const T& back() const { return end_[-1]; }
+  const T& operator[](size_t index) const { return begin_[index]; }
+
+ private:
+  const T* begin_ = nullptr;
+  const T* end_ = nullptr;
+};
+
+// Непрерывный отрезок идентификаторов внутри снимка
+using IdRange = Span<uint32_t>;
+
+// Соседняя остановка и расстояние до неё
+struct RoadTarget {
+  StopId to;
+  uint32_t distance;
+};
+
+// Расстояние до to среди соседей, упорядоченных по возрастанию,
+// или 0, если его нет
+uint32_t FindDistance(Span<RoadTarget> targets, StopId to);
+
+// Совершенное хеширование имён (hash and displace): имя попадает в корзину,
+// а корзина хранит сдвиг, при котором все её имена получают свободные
+// ячейки. Поиск - одно хеширование и одно сравнение строк
+class NameIndex {
+ public:
+  // Номер имени - его позиция в names
+  struct Table {
+    uint64_t seed = 0;
+    std::vector<uint32_t> displacements;
+    std::vector<uint32_t> slots;
+  };
+
+  static Table Build(const std::vector<std::string_view>& names);
+  // Индексируются только ids, имена которых попарно различны
+  static Table Build(const std::vector<std::string_view>& names,
+                     const std::vector<uint32_t>& ids);
+
+  NameIndex() = default;
+  NameIndex(uint64_t seed, Span<uint32_t> displacements, Span<uint32_t> slots)
+      : seed_(seed), displacements_(displacements), slots_(slots) {}
+
+  // names[id] возвращает имя с номером id
+  template <typename Names>
+  std::optional<uint32_t> Find(std::string_view name,
+                               const Names& names) const {
+    if (displacements_.empty()) {
+      return std::nullopt;
+    }
+    const uint64_t hash = Hash(seed_, name);
+    const uint32_t id = slots_[Slot(
+        hash, displacements_[hash % displacements_.size()], slots_.size())];
+    if (id == EMPTY || names[id] != name) {
+      return std::nullopt;
+    }
+    return id;
+  }
+
+ private:
+  static constexpr uint32_t EMPTY = UINT32_MAX;
+
+  uint64_t seed_ = 0;
+  Span<uint32_t> displacements_;
+  Span<uint32_t> slots_;
+
+  static uint64_t Hash(uint64_t seed, std::string_view name);
+  static size_t Slot(uint64_t hash, uint32_t displacement, size_t slot_count);
+  static bool TryBuild(Table& table, const std::vector<std::string_view>& names,
+                       const std::vector<uint32_t>& ids);
+};
+
+// Имена подряд в одном буфере, имя id занимает [offsets[id], offsets[id + 1])
+class NameTable {
+ public:
+  NameTable() = default;
+  NameTable(Span<uint32_t> offsets, Span<char> chars)
+      : offsets_(offsets), chars_(chars) {}
+
+  size_t size() const { return offsets_.empty() ? 0 : offsets_.size() - 1; }
+  std::string_view operator[](uint32_t id) const {
+    return {chars_.begin() + offsets_[id], offsets_[id + 1] - offsets_[id]};
+  }
+
+ private:
+  Span<uint32_t> offsets_;
+  Span<char> chars_;
+};
+
+// Точка пространственного индекса. Лежат в порядке обхода дерева
+struct SpatialPoint {
+  double lat;
+  double lng;
+  StopId id;
+  uint32_t reserved;
+};
+
+// Неявное k-d дерево по широте и долготе: корень отрезка точек - его
+// середина, слева точки не больше корня по оси, справа не меньше.
+// Оси чередуются с глубиной, начиная с широты. Дерево не хранит
+// указателей и читается прямо из образа снимка
+class SpatialIndex {
+ public:
+  struct Neighbor {
+    StopId id;
+    // Расстояние по сфере в метрах
+    double distance;
+  };
+
+  // Переставляет points в порядок дерева
+  static void Build(std::vector<SpatialPoint>& points);
+
+  SpatialIndex() = default;
+  explicit SpatialIndex(Span<SpatialPoint> points) : points_(points) {}
+
+  // Не больше count ближайших точек, от ближних к дальним
+  std::vector<Neighbor> Nearest(Coordinates from, size_t count) const;
+
+  // Точки в прямоугольнике вместе с границами, в порядке дерева.
+  // Если min.lng > max.lng, прямоугольник пересекает 180-й меридиан
+  std::vector<StopId> InBox(Coordinates min, Coordinates max) const;
+
+ private:
+  Span<SpatialPoint> points_;
+};
+
+// Ребро иерархии сжатий дорожного графа, см. RoadRouter. Концы
+// и via - номера остановок в иерархии. Срезка заменяет путь через via,
+// менее важную, чем оба конца. Цепочка срезок может быть длиннее
+// любой дороги, поэтому длина 64-битная
+struct HierarchyEdge {
+  static constexpr uint32_t NO_VIA = UINT32_MAX;
+
+  uint32_t to;
+  uint32_t via;
+  uint64_t distance;
+};
+
+// Иерархия сжатий дорожного графа, см. RoadRouter. Не владеет данными.
+// Остановки пронумерованы по важности: сначала сжатые в порядке сжатия,
+// затем несжатое ядро. Верх иерархии, который просматривает каждый
+// запрос, так лежит в памяти подряд. Рёбра остановки упорядочены по длине
+class RoadHierarchy {
+ public:
+  RoadHierarchy() = default;
+  RoadHierarchy(Span<uint32_t> up_offsets, Span<HierarchyEdge> up_edges,
+                Span<uint32_t> down_offsets, Span<HierarchyEdge> down_edges,
+                Span<uint32_t> ranks, Span<StopId> stops, uint32_t core_rank)
+      : up_offsets_(up_offsets),
+        up_edges_(up_edges),
+        down_offsets_(down_offsets),
+        down_edges_(down_edges),
+        ranks_(ranks),
+        stops_(stops),
+        core_rank_(core_rank) {}
+
+  // Иерархию не строили
+  bool empty() const { return up_offsets_.empty(); }
+
+  uint32_t Rank(StopId stop) const { return ranks_[stop]; }
+  StopId Stop(uint32_t rank) const { return stops_[rank]; }
+
+  // Рёбра в более важные
+  Span<HierarchyEdge> UpwardEdges(uint32_t rank) const {
+    return Range(up_offsets_, up_edges_, rank);
+  }
+  // Рёбра из более важных, to - начало ребра
+  Span<HierarchyEdge> DownwardEdges(uint32_t rank) const {
+    return Range(down_offsets_, down_edges_, rank);
+  }
+  // Рёбра ядра ведут только в ядро
+  bool InCore(uint32_t rank) const { return rank >= core_rank_; }
+
+ private:
+  Span<uint32_t> up_offsets_;
+  Span<HierarchyEdge> up_edges_;
+  Span<uint32_t> down_offsets_;
+  Span<HierarchyEdge> down_edges_;
+  Span<uint32_t> ranks_;
+  Span<StopId> stops_;
+  uint32_t core_rank_ = 0;
+
+  static Span<HierarchyEdge> Range(Span<uint32_t> offsets,
+                                   Span<HierarchyEdge> edges, uint32_t rank) {
+    return Span<HierarchyEdge>(edges.begin() + offsets[rank],
+                               edges.begin() + offsets[rank + 1]);
+  }
+};
+
+// Неизменяемый снимок каталога, оптимизированный для чтения.
+// Снимок - это образ: заголовок с таблицей разделов и сами разделы,
+// выровненные на 8 байт, со смещениями от начала образа. Образ строится
+// Catalogue::Freeze в памяти или отображается из файла без копирования.
+// После создания снимок не меняется, поэтому его можно читать
+// из нескольких потоков без блокировок
+class Snapshot {
+ public:
+  struct BusStats {
+    int stop_count = 0;
+    int unique_stop_count = 0;
+    double route_length = 0;
+    double curvature = 0;
+  };
+
+  // Содержимое снимка, из которого собирается образ
+  struct Data {
+    std::vector<std::string_view> stop_names;
+    std::vector<std::string_view> bus_names;
+    std::vector<double> latitudes;
+    std::vector<double> longitudes;
+    std::vector<uint32_t> stop_bus_offsets;
+    std::vector<BusId> stop_buses;
+    // Остановки маршрутов только в прямом направлении
+    std::vector<uint32_t> bus_stop_offsets;
+    std::vector<StopId> bus_stops;
+    std::vector<uint8_t> bus_roundtrips;
+    std::vector<BusStats> bus_stats;
+    std::vector<uint32_t> road_offsets;
+    std::vector<RoadTarget> road_targets;
+    // Удалённые сохраняют номера, но не ищутся по имени
+    // и не попадают в упорядочения по имени
+    std::vector<uint8_t> stop_removed;
+    std::vector<uint8_t> bus_removed;
+  };
+
+  // Построенная иерархия сжатий, см. RoadHierarchy
+  struct Hierarchy {
+    std::vector<uint32_t> up_offsets;
+    std::vector<HierarchyEdge> up_edges;
+    std::vector<uint32_t> down_offsets;
+    std::vector<HierarchyEdge> down_edges;
+    // Номер каждой остановки и остановка с каждым номером
+    std::vector<uint32_t> ranks;
+    std::vector<StopId> stops;
+    uint32_t core_rank = 0;
+
+    RoadHierarchy View() const {
+      return RoadHierarchy(up_offsets, up_edges, down_offsets, down_edges,
+                           ranks, stops, core_rank);
+    }
+  };
+
+  // Формат образа. Меняется при любом изменении разделов
+  static constexpr uint32_t VERSION = 6;
+
+  explicit Snapshot(const Data& data);
+
+  // Отображает файл, записанный Save, в память. Файл должен быть записан
+  // этой же версией программы на машине с тем же порядком байтов
+  // и не повреждён: это проверяет контрольная сумма. Иначе бросается
+  // std::runtime_error
+  static std::shared_ptr<const Snapshot> Load(const std::string& path);
+
+  // settings - произвольные байты, их вернёт Settings загруженного снимка.
+  // Если hierarchy задана, она сохраняется вместо иерархии снимка
+  void Save(std::ostream& output, std::string_view settings = {},
+            const Hierarchy* hierarchy = nullptr) const;
+  std::string_view Settings() const { return settings_; }
+
+  size_t StopCount() const { return stop_names_.size(); }
+  size_t BusCount() const { return bus_names_.size(); }
+
+  std::optional<StopId> FindStop(std::string_view name) const {
+    return stop_index_.Find(name, stop_names_);
+  }
+  std::optional<BusId> FindBus(std::string_view name) const {
+    return bus_index_.Find(name, bus_names_);
+  }
+
+  std::string_view StopName(StopId id) const { return stop_names_[id]; }
+  std::string_view BusName(BusId id) const { return bus_names_[id]; }
+
+  Coordinates StopCoordinates(StopId id) const {
+    return Coordinates{latitudes_[id], longitudes_[id]};
+  }
+
+  // Маршруты через остановку, упорядоченные по названию
+  IdRange StopBuses(StopId id) const {
+    return Range(stop_bus_offsets_, stop_buses_, id);
+  }
+  // Остановки маршрута в порядке проезда, туда и обратно
+  RouteView BusStops(BusId id) const {
+    const IdRange forward = Range(bus_stop_offsets_, bus_stops_, id);
+    return RouteView(forward.begin(), forward.end(), bus_roundtrips_[id] != 0);
+  }
+
+  const BusStats& GetBusStats(BusId id) const { return bus_stats_[id]; }
+
+  // Дорожное расстояние между соседними остановками или 0
+  uint32_t GetDistance(StopId from, StopId to) const {
+    return FindDistance(Range(road_offsets_, road_targets_, from), to);
+  }
+
+  // Дороги от остановки, упорядоченные по to
+  Span<RoadTarget> Roads(StopId id) const {
+    return Range(road_offsets_, road_targets_, id);
+  }
+
+  // Иерархия сжатий есть только в снимках, сохранённых с ней.
+  // Freeze её не строит, чтобы не замедлять обновления
+  const RoadHierarchy& GetRoadHierarchy() const { return road_hierarchy_; }
+
+  // Все остановки и маршруты, упорядоченные по имени
+  Span<StopId> StopsByName() const { return stops_by_name_; }
+  Span<BusId> BusesByName() const { return buses_by_name_; }
+
+  // Ближайшие к точке остановки, от ближних к дальним
+  std::vector<SpatialIndex::Neighbor> NearestStops(Coordinates from,
+                                                   size_t count) const {
+    return spatial_index_.Nearest(from, count);
+  }
+  // Остановки в прямоугольнике, см. SpatialIndex::InBox
+  std::vector<StopId> StopsInBox(Coordinates min, Coordinates max) const {
+    return spatial_index_.InBox(min, max);
+  }
+
+ private:
+  // Владеет памятью образа: строкой или отображённым файлом
+  std::shared_ptr<const void> owner_;
+  std::string_view image_;
+
+  NameTable stop_names_;
+  NameTable bus_names_;
+  Span<double> latitudes_;
+  Span<double> longitudes_;
+  Span<uint32_t> stop_bus_offsets_;
+  Span<BusId> stop_buses_;
+  Span<uint32_t> bus_stop_offsets_;
+  Span<StopId> bus_stops_;
+  Span<uint8_t> bus_roundtrips_;
+  Span<BusStats> bus_stats_;
+  Span<uint32_t> road_offsets_;
+  Span<RoadTarget> road_targets_;
+  RoadHierarchy road_hierarchy_;
+  Span<StopId> stops_by_name_;
+  Span<BusId> buses_by_name_;
+  NameIndex stop_index_;
+  NameIndex bus_index_;
+  SpatialIndex spatial_index_;
+  std::string_view settings_;
+
+  explicit Snapshot(std::shared_ptr<const std::string> image);
+  Snapshot(std::shared_ptr<const void> owner, std::string_view image);
+
+  template <typename T>
+  static Span<T> Range(Span<uint32_t> offsets, Span<T> items, uint32_t id) {
+    return Span<T>(items.begin() + offsets[id], items.begin() + offsets[id + 1]);
+  }
+};
+
+}  // namespace transport
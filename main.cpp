@@ -1,10 +1,42 @@
 #include "json_builder.h"
+#include "json_reader.h"
+#include <exception>
 #include <iostream>
+#include <string_view>
 
 
 using namespace std;
 
-int main() {
+// make_base строит каталог по base_requests и сохраняет его в файл,
+// process_requests отвечает на stat_requests по сохранённому файлу
+int RunMode(string_view mode) {
+    if (mode != "make_base"sv && mode != "process_requests"sv) {
+        cerr << "Usage: main [make_base|process_requests]"sv << endl;
+        return 1;
+    }
+    transport::Catalogue catalogue;
+    renderer::MapRenderer renderer;
+    RequestHandler handler(catalogue, renderer);
+    try {
+        JsonReader reader(handler, cin);
+        if (mode == "make_base"sv) {
+            reader.SaveBase();
+        } else {
+            reader.LoadBase();
+            reader.Print(cout);
+        }
+    } catch (const exception& e) {
+        cerr << mode << ": "sv << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc == 2) {
+        return RunMode(argv[1]);
+    }
+
     json::Print(
         json::Document{
             json::Builder{}
@@ -1,12 +1,59 @@
 #include "geo.h"
 
-inline const int EarthRadius = 6371000;
+#include <algorithm>
+
+namespace {
+
+const double dr = M_PI / 180.0;
+
+// Столько отрезков пути обрабатывается за один проход
+constexpr size_t BATCH_SIZE = 64;
+
+}  // namespace
 
 double ComputeDistance(Coordinates from, Coordinates to) {
   using namespace std;
-  static const double dr = M_PI / 180.0;
   return acos(sin(from.lat * dr) * sin(to.lat * dr) +
               cos(from.lat * dr) * cos(to.lat * dr) *
                   cos(abs(from.lng - to.lng) * dr)) *
          EarthRadius;
-}
\ No newline at end of file
+}
+
+GeoPoint::GeoPoint(Coordinates coord)
+    : sin_lat(std::sin(coord.lat * dr)),
+      cos_lat(std::cos(coord.lat * dr)),
+      lng(coord.lng) {}
+
+// Отрезки обрабатываются пачками: сначала точки собираются в плотные
+// массивы, затем арифметика идёт простыми циклами без ветвлений, которые
+// компилятор может векторизовать. Тригонометрия остаётся из libm:
+// её векторные варианты требуют -ffast-math и меняют результат
+double ComputePathLength(const GeoPoint* points, const uint32_t* path,
+                         size_t count) {
+  using namespace std;
+  double sin_product[BATCH_SIZE];
+  double cos_product[BATCH_SIZE];
+  double angle[BATCH_SIZE];
+  double length = 0;
+  for (size_t first = 1; first < count; first += BATCH_SIZE) {
+    const size_t size = min(BATCH_SIZE, count - first);
+    const uint32_t* segment = path + first;
+    for (size_t i = 0; i < size; ++i) {
+      const GeoPoint& from = points[segment[i - 1]];
+      const GeoPoint& to = points[segment[i]];
+      sin_product[i] = from.sin_lat * to.sin_lat;
+      cos_product[i] = from.cos_lat * to.cos_lat;
+      angle[i] = abs(from.lng - to.lng) * dr;
+    }
+    for (size_t i = 0; i < size; ++i) {
+      angle[i] = cos(angle[i]);
+    }
+    for (size_t i = 0; i < size; ++i) {
+      angle[i] = sin_product[i] + cos_product[i] * angle[i];
+    }
+    for (size_t i = 0; i < size; ++i) {
+      length += acos(angle[i]) * EarthRadius;
+    }
+  }
+  return length;
+}
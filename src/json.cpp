@@ -1,49 +1,136 @@
 #include "json.h"
 
+#include <algorithm>
+#include <charconv>
 #include <iterator>
 
+#include "json_writer.h"
+#include "mapped_file.h"
+
 namespace json {
 
 namespace {
 using namespace std::literals;
 
-Node LoadNode(std::istream& input);
-Node LoadString(std::istream& input);
+// Разбирает JSON из непрерывного буфера, перемещаясь по нему указателем.
+// Буфер должен оставаться живым на время разбора, но не после него:
+// все строки копируются в узлы.
+class Parser {
+public:
+    explicit Parser(std::string_view input,
+                    std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : pos_(input.data())
+        , end_(input.data() + input.size())
+        , resource_(resource) {
+        // Метку порядка байтов UTF-8 оставляют некоторые редакторы
+        if (input.substr(0, UTF8_BOM.size()) == UTF8_BOM) {
+            pos_ += UTF8_BOM.size();
+        }
+    }
 
-std::string LoadLiteral(std::istream& input) {
-    std::string s;
-    while (std::isalpha(input.peek())) {
-        s.push_back(static_cast<char>(input.get()));
+    Node LoadNode();
+    void ParseNode(Handler& handler);
+
+private:
+    static constexpr std::string_view UTF8_BOM = "\xEF\xBB\xBF"sv;
+
+    const char* pos_;
+    const char* end_;
+    std::pmr::memory_resource* resource_;
+    std::vector<Node> stack_;
+    std::vector<Dict::value_type> dict_stack_;
+
+    static bool IsSpace(char c) {
+        return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
     }
-    return s;
+    static bool IsDigit(char c) {
+        return c >= '0' && c <= '9';
+    }
+    static bool IsAlpha(char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+    }
+
+    // Пропускает пробельные символы и считывает в c следующий символ.
+    // Возвращает false, если буфер закончился
+    bool NextToken(char& c) {
+        while (pos_ != end_ && IsSpace(*pos_)) {
+            ++pos_;
+        }
+        if (pos_ == end_) {
+            return false;
+        }
+        c = *pos_++;
+        return true;
+    }
+
+    int Peek() const {
+        return pos_ != end_ ? static_cast<unsigned char>(*pos_) : EOF;
+    }
+
+    std::string_view LoadLiteral();
+    Node LoadArray();
+    Node LoadDict();
+    void ParseArray(Handler& handler);
+    void ParseDict(Handler& handler);
+    Node LoadScalar(char c);
+    std::string LoadString();
+    Node LoadBool();
+    Node LoadNull();
+    Node LoadNumber();
+};
+
+std::string_view Parser::LoadLiteral() {
+    const char* begin = pos_;
+    while (pos_ != end_ && IsAlpha(*pos_)) {
+        ++pos_;
+    }
+    return {begin, static_cast<size_t>(pos_ - begin)};
 }
 
-Node LoadArray(std::istream& input) {
-    std::vector<Node> result;
+Node Parser::LoadArray() {
+    // Элементы копятся на общем стеке, чтобы массив получил память один раз
+    // и ровно нужного размера: в арене перевыделения оставляли бы дыры
+    const size_t first = stack_.size();
 
-    for (char c; input >> c && c != ']';) {
+    char c;
+    bool closed = false;
+    while (NextToken(c)) {
+        if (c == ']') {
+            closed = true;
+            break;
+        }
         if (c != ',') {
-            input.putback(c);
+            --pos_;
         }
-        result.push_back(LoadNode(input));
+        Node item = LoadNode();
+        stack_.push_back(std::move(item));
     }
-    if (!input) {
+    if (!closed) {
         throw ParsingError("Array parsing error"s);
     }
+    Array result(std::make_move_iterator(stack_.begin() + first),
+                 std::make_move_iterator(stack_.end()), resource_);
+    stack_.resize(first);
     return Node(std::move(result));
 }
 
-Node LoadDict(std::istream& input) {
-    Dict dict;
+Node Parser::LoadDict() {
+    // Пары копятся на общем стеке и сортируются один раз, а не вставляются
+    // по одной в середину словаря
+    const size_t first = dict_stack_.size();
 
-    for (char c; input >> c && c != '}';) {
+    char c;
+    bool closed = false;
+    while (NextToken(c)) {
+        if (c == '}') {
+            closed = true;
+            break;
+        }
         if (c == '"') {
-            std::string key = LoadString(input).AsString();
-            if (input >> c && c == ':') {
-                if (dict.find(key) != dict.end()) {
-                    throw ParsingError("Duplicate key '"s + key + "' have been found");
-                }
-                dict.emplace(std::move(key), LoadNode(input));
+            std::string key = LoadString();
+            if (NextToken(c) && c == ':') {
+                Node value = LoadNode();
+                dict_stack_.emplace_back(std::move(key), std::move(value));
             } else {
                 throw ParsingError(": is expected but '"s + c + "' has been found"s);
             }
@@ -51,30 +138,46 @@ Node LoadDict(std::istream& input) {
             throw ParsingError(R"(',' is expected but ')"s + c + "' has been found"s);
         }
     }
-    if (!input) {
+    if (!closed) {
         throw ParsingError("Dictionary parsing error"s);
     }
+
+    const auto begin = dict_stack_.begin() + first;
+    std::sort(begin, dict_stack_.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.first < rhs.first;
+    });
+    const auto duplicate = std::adjacent_find(begin, dict_stack_.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.first == rhs.first;
+    });
+    if (duplicate != dict_stack_.end()) {
+        throw ParsingError("Duplicate key '"s + duplicate->first + "' have been found");
+    }
+    Dict dict(std::make_move_iterator(begin), std::make_move_iterator(dict_stack_.end()), resource_);
+    dict_stack_.resize(first);
     return Node(std::move(dict));
 }
 
-Node LoadString(std::istream& input) {
-    auto it = std::istreambuf_iterator<char>(input);
-    auto end = std::istreambuf_iterator<char>();
+std::string Parser::LoadString() {
     std::string s;
     while (true) {
-        if (it == end) {
+        // Копируем сразу весь отрезок без спецсимволов
+        const char* run = pos_;
+        while (run != end_ && *run != '"' && *run != '\\' && *run != '\n' && *run != '\r') {
+            ++run;
+        }
+        s.append(pos_, run);
+        pos_ = run;
+        if (pos_ == end_) {
             throw ParsingError("String parsing error");
         }
-        const char ch = *it;
+        const char ch = *pos_++;
         if (ch == '"') {
-            ++it;
             break;
         } else if (ch == '\\') {
-            ++it;
-            if (it == end) {
+            if (pos_ == end_) {
                 throw ParsingError("String parsing error");
             }
-            const char escaped_char = *(it);
+            const char escaped_char = *pos_++;
             switch (escaped_char) {
                 case 'n':
                     s.push_back('\n');
@@ -94,63 +197,52 @@ Node LoadString(std::istream& input) {
                 default:
                     throw ParsingError("Unrecognized escape sequence \\"s + escaped_char);
             }
-        } else if (ch == '\n' || ch == '\r') {
-            throw ParsingError("Unexpected end of line"s);
         } else {
-            s.push_back(ch);
+            throw ParsingError("Unexpected end of line"s);
         }
-        ++it;
     }
 
-    return Node(std::move(s));
+    return s;
 }
 
-Node LoadBool(std::istream& input) {
-    const auto s = LoadLiteral(input);
+Node Parser::LoadBool() {
+    const auto s = LoadLiteral();
     if (s == "true"sv) {
         return Node{true};
     } else if (s == "false"sv) {
         return Node{false};
     } else {
-        throw ParsingError("Failed to parse '"s + s + "' as bool"s);
+        throw ParsingError("Failed to parse '"s + std::string(s) + "' as bool"s);
     }
 }
 
-Node LoadNull(std::istream& input) {
-    if (auto literal = LoadLiteral(input); literal == "null"sv) {
+Node Parser::LoadNull() {
+    if (auto literal = LoadLiteral(); literal == "null"sv) {
         return Node{nullptr};
     } else {
-        throw ParsingError("Failed to parse '"s + literal + "' as null"s);
+        throw ParsingError("Failed to parse '"s + std::string(literal) + "' as null"s);
     }
 }
 
-Node LoadNumber(std::istream& input) {
-    std::string parsed_num;
+Node Parser::LoadNumber() {
+    const char* begin = pos_;
 
-    // Считывает в parsed_num очередной символ из input
-    auto read_char = [&parsed_num, &input] {
-        parsed_num += static_cast<char>(input.get());
-        if (!input) {
-            throw ParsingError("Failed to read number from stream"s);
-        }
-    };
-
-    // Считывает одну или более цифр в parsed_num из input
-    auto read_digits = [&input, read_char] {
-        if (!std::isdigit(input.peek())) {
+    // Считывает одну или более цифр
+    auto read_digits = [this] {
+        if (!IsDigit(static_cast<char>(Peek()))) {
             throw ParsingError("A digit is expected"s);
         }
-        while (std::isdigit(input.peek())) {
-            read_char();
+        while (pos_ != end_ && IsDigit(*pos_)) {
+            ++pos_;
         }
     };
 
-    if (input.peek() == '-') {
-        read_char();
+    if (Peek() == '-') {
+        ++pos_;
     }
     // Парсим целую часть числа
-    if (input.peek() == '0') {
-        read_char();
+    if (Peek() == '0') {
+        ++pos_;
         // После 0 в JSON не могут идти другие цифры
     } else {
         read_digits();
@@ -158,194 +250,221 @@ Node LoadNumber(std::istream& input) {
 
     bool is_int = true;
     // Парсим дробную часть числа
-    if (input.peek() == '.') {
-        read_char();
+    if (Peek() == '.') {
+        ++pos_;
         read_digits();
         is_int = false;
     }
 
     // Парсим экспоненциальную часть числа
-    if (int ch = input.peek(); ch == 'e' || ch == 'E') {
-        read_char();
-        if (ch = input.peek(); ch == '+' || ch == '-') {
-            read_char();
+    if (int ch = Peek(); ch == 'e' || ch == 'E') {
+        ++pos_;
+        if (ch = Peek(); ch == '+' || ch == '-') {
+            ++pos_;
         }
         read_digits();
         is_int = false;
     }
 
-    try {
-        if (is_int) {
-            // Сначала пробуем преобразовать строку в int
-            try {
-                return std::stoi(parsed_num);
-            } catch (...) {
-                // В случае неудачи, например, при переполнении
-                // код ниже попробует преобразовать строку в double
-            }
+    // Число разбирается прямо из буфера, без копирования и исключений
+    if (is_int) {
+        int value;
+        const auto [end, ec] = std::from_chars(begin, pos_, value);
+        if (ec == std::errc{} && end == pos_) {
+            return value;
         }
-        return std::stod(parsed_num);
-    } catch (...) {
-        throw ParsingError("Failed to convert "s + parsed_num + " to number"s);
+        // Не поместившееся в int целое разбирается ниже как double
+    }
+    double value;
+    const auto [end, ec] = std::from_chars(begin, pos_, value);
+    if (ec != std::errc{} || end != pos_) {
+        throw ParsingError("Failed to convert "s + std::string(begin, pos_) + " to number"s);
     }
+    return value;
 }
 
-Node LoadNode(std::istream& input) {
-    char c;
-    if (!(input >> c)) {
-        throw ParsingError("Unexpected EOF"s);
-    }
+Node Parser::LoadScalar(char c) {
     switch (c) {
-        case '[':
-            return LoadArray(input);
-        case '{':
-            return LoadDict(input);
         case '"':
-            return LoadString(input);
+            return Node{LoadString()};
         case 't':
-            // Атрибут [[fallthrough]] (провалиться) ничего не делает, и является
-            // подсказкой компилятору и человеку, что здесь программист явно задумывал
-            // разрешить переход к инструкции следующей ветки case, а не случайно забыл
-            // написать break, return или throw.
-            // В данном случае, встретив t или f, переходим к попытке парсинга
+            // Встретив t или f, переходим к попытке парсинга
             // литералов true либо false
             [[fallthrough]];
         case 'f':
-            input.putback(c);
-            return LoadBool(input);
+            --pos_;
+            return LoadBool();
         case 'n':
-            input.putback(c);
-            return LoadNull(input);
+            --pos_;
+            return LoadNull();
         default:
-            input.putback(c);
-            return LoadNumber(input);
+            --pos_;
+            return LoadNumber();
     }
 }
 
-struct PrintContext {
-    std::ostream& out;
-    int indent_step = 4;
-    int indent = 0;
+Node Parser::LoadNode() {
+    char c;
+    if (!NextToken(c)) {
+        throw ParsingError("Unexpected EOF"s);
+    }
+    switch (c) {
+        case '[':
+            return LoadArray();
+        case '{':
+            return LoadDict();
+        default:
+            return LoadScalar(c);
+    }
+}
+
+void Parser::ParseArray(Handler& handler) {
+    handler.StartArray();
 
-    void PrintIndent() const {
-        for (int i = 0; i < indent; ++i) {
-            out.put(' ');
+    char c;
+    bool closed = false;
+    while (NextToken(c)) {
+        if (c == ']') {
+            closed = true;
+            break;
+        }
+        if (c != ',') {
+            --pos_;
+        }
+        ParseNode(handler);
+    }
+    if (!closed) {
+        throw ParsingError("Array parsing error"s);
+    }
+    handler.EndArray();
+}
+
+void Parser::ParseDict(Handler& handler) {
+    handler.StartDict();
+
+    char c;
+    bool closed = false;
+    while (NextToken(c)) {
+        if (c == '}') {
+            closed = true;
+            break;
+        }
+        if (c == '"') {
+            std::string key = LoadString();
+            if (NextToken(c) && c == ':') {
+                handler.Key(std::move(key));
+                ParseNode(handler);
+            } else {
+                throw ParsingError(": is expected but '"s + c + "' has been found"s);
+            }
+        } else if (c != ',') {
+            throw ParsingError(R"(',' is expected but ')"s + c + "' has been found"s);
         }
     }
+    if (!closed) {
+        throw ParsingError("Dictionary parsing error"s);
+    }
+    handler.EndDict();
+}
+
+void Parser::ParseNode(Handler& handler) {
+    char c;
+    if (!NextToken(c)) {
+        throw ParsingError("Unexpected EOF"s);
+    }
+    switch (c) {
+        case '[':
+            ParseArray(handler);
+            break;
+        case '{':
+            ParseDict(handler);
+            break;
+        default:
+            handler.Value(LoadScalar(c));
+            break;
+    }
+}
 
-    PrintContext Indented() const {
-        return {out, indent_step, indent_step + indent};
+// Читает остаток потока в одну строку. Если поток позволяет узнать
+// свой размер, память выделяется один раз
+std::string ReadAll(std::istream& input) {
+    std::string result;
+    const auto start = input.tellg();
+    if (start != std::istream::pos_type(-1) && input.seekg(0, std::ios::end)) {
+        const auto size = input.tellg() - start;
+        input.seekg(start);
+        result.resize(static_cast<size_t>(size));
+        input.read(result.data(), size);
+        result.resize(static_cast<size_t>(input.gcount()));
+        return result;
+    }
+    input.clear();
+    char chunk[1 << 16];
+    while (input.read(chunk, sizeof(chunk)) || input.gcount() > 0) {
+        result.append(chunk, static_cast<size_t>(input.gcount()));
     }
+    return result;
+}
+
+// Корень документа вместе с ареной, в которой он размещён.
+// Поля уничтожаются в обратном порядке: сначала дерево, затем арена
+struct ArenaRoot {
+    std::unique_ptr<std::pmr::memory_resource> arena;
+    Node root;
 };
 
-void PrintNode(const Node& value, const PrintContext& ctx);
+}  // namespace
 
-template <typename Value>
-void PrintValue(const Value& value, const PrintContext& ctx) {
-    ctx.out << value;
+Document::Document(Node root)
+    : root_(std::make_shared<const Node>(std::move(root))) {
 }
 
-void PrintString(const std::string& value, std::ostream& out) {
-    out.put('"');
-    for (const char c : value) {
-        switch (c) {
-            case '\r':
-                out << "\\r"sv;
-                break;
-            case '\n':
-                out << "\\n"sv;
-                break;
-            case '"':
-                // Символы " и \ выводятся как \" или \\, соответственно
-                [[fallthrough]];
-            case '\\':
-                out.put('\\');
-                [[fallthrough]];
-            default:
-                out.put(c);
-                break;
-        }
-    }
-    out.put('"');
+Document::Document(Node root, std::unique_ptr<std::pmr::memory_resource> arena) {
+    auto holder = std::make_shared<ArenaRoot>(ArenaRoot{std::move(arena), std::move(root)});
+    root_ = std::shared_ptr<const Node>(holder, &holder->root);
 }
 
-template <>
-void PrintValue<std::string>(const std::string& value, const PrintContext& ctx) {
-    PrintString(value, ctx.out);
+Document Load(std::istream& input) {
+    return Load(std::string_view{ReadAll(input)});
 }
 
-template <>
-void PrintValue<std::nullptr_t>(const std::nullptr_t&, const PrintContext& ctx) {
-    ctx.out << "null"sv;
+Document Load(std::string_view input) {
+    return Document{Parser{input}.LoadNode()};
 }
 
-// В специализаци шаблона PrintValue для типа bool параметр value передаётся
-// по константной ссылке, как и в основном шаблоне.
-// В качестве альтернативы можно использовать перегрузку:
-// void PrintValue(bool value, const PrintContext& ctx);
-template <>
-void PrintValue<bool>(const bool& value, const PrintContext& ctx) {
-    ctx.out << (value ? "true"sv : "false"sv);
+Document Load(std::string_view input, std::unique_ptr<std::pmr::memory_resource> arena) {
+    Node root = Parser{input, arena.get()}.LoadNode();
+    return Document{std::move(root), std::move(arena)};
 }
 
-template <>
-void PrintValue<Array>(const Array& nodes, const PrintContext& ctx) {
-    std::ostream& out = ctx.out;
-    out << "[\n"sv;
-    bool first = true;
-    auto inner_ctx = ctx.Indented();
-    for (const Node& node : nodes) {
-        if (first) {
-            first = false;
-        } else {
-            out << ",\n"sv;
-        }
-        inner_ctx.PrintIndent();
-        PrintNode(node, inner_ctx);
-    }
-    out.put('\n');
-    ctx.PrintIndent();
-    out.put(']');
+Document LoadFile(const std::string& path) {
+    const MappedFile file(path);
+    return Load(file.GetData());
 }
 
-template <>
-void PrintValue<Dict>(const Dict& nodes, const PrintContext& ctx) {
-    std::ostream& out = ctx.out;
-    out << "{\n"sv;
-    bool first = true;
-    auto inner_ctx = ctx.Indented();
-    for (const auto& [key, node] : nodes) {
-        if (first) {
-            first = false;
-        } else {
-            out << ",\n"sv;
-        }
-        inner_ctx.PrintIndent();
-        PrintString(key, ctx.out);
-        out << ": "sv;
-        PrintNode(node, inner_ctx);
-    }
-    out.put('\n');
-    ctx.PrintIndent();
-    out.put('}');
+void Parse(std::istream& input, Handler& handler) {
+    Parse(std::string_view{ReadAll(input)}, handler);
 }
 
-void PrintNode(const Node& node, const PrintContext& ctx) {
-    std::visit(
-        [&ctx](const auto& value) {
-            PrintValue(value, ctx);
-        },
-        node.GetValue());
+void Parse(std::string_view input, Handler& handler) {
+    Parser{input}.ParseNode(handler);
 }
 
-}  // namespace
+Document LoadBinary(std::istream& input) {
+    return LoadBinary(std::string_view{ReadAll(input)});
+}
 
-Document Load(std::istream& input) {
-    return Document{LoadNode(input)};
+void ParseBinary(std::istream& input, Handler& handler) {
+    ParseBinary(std::string_view{ReadAll(input)}, handler);
 }
 
 void Print(const Document& doc, std::ostream& output) {
-    PrintNode(doc.GetRoot(), PrintContext{output});
+    Print(doc, output, PrintSettings{});
+}
+
+void Print(const Document& doc, std::ostream& output, const PrintSettings& settings) {
+    Writer writer(output, settings);
+    writer.Value(doc.GetRoot());
 }
 
 }  // namespace json
\ No newline at end of file
@@ -0,0 +1,339 @@
+#include "json.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <iterator>
+
+namespace json {
+
+namespace {
+using namespace std::literals;
+
+// Старшие три бита первого байта элемента CBOR
+enum Major : uint8_t {
+    UNSIGNED = 0,
+    NEGATIVE = 1,
+    TEXT = 3,
+    ARRAY = 4,
+    MAP = 5,
+    SIMPLE = 7,
+};
+
+constexpr uint8_t FALSE_BYTE = 0xf4;
+constexpr uint8_t TRUE_BYTE = 0xf5;
+constexpr uint8_t NULL_BYTE = 0xf6;
+constexpr uint8_t FLOAT_BYTE = 0xfa;
+constexpr uint8_t DOUBLE_BYTE = 0xfb;
+
+// Младшие пять битов: само значение, если оно меньше 24,
+// иначе размер следующего за ним числа
+constexpr uint8_t DIRECT_LIMIT = 24;
+
+constexpr size_t FLUSH_SIZE = size_t{1} << 16;
+
+class BinaryWriter {
+public:
+    explicit BinaryWriter(std::ostream& output)
+        : output_(output) {
+        buffer_.reserve(FLUSH_SIZE + FLUSH_SIZE / 4);
+    }
+
+    ~BinaryWriter() {
+        output_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+    }
+
+    void WriteNode(const Node& node) {
+        if (buffer_.size() >= FLUSH_SIZE) {
+            output_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+            buffer_.clear();
+        }
+        if (node.IsDict()) {
+            const Dict& dict = node.AsDict();
+            WriteHead(MAP, dict.size());
+            for (const auto& [key, value] : dict) {
+                WriteText(key);
+                WriteNode(value);
+            }
+        } else if (node.IsArray()) {
+            const Array& array = node.AsArray();
+            WriteHead(ARRAY, array.size());
+            for (const Node& value : array) {
+                WriteNode(value);
+            }
+        } else if (node.IsString()) {
+            WriteText(node.AsString());
+        } else if (node.IsInt()) {
+            const int64_t value = node.AsInt();
+            if (value >= 0) {
+                WriteHead(UNSIGNED, static_cast<uint64_t>(value));
+            } else {
+                WriteHead(NEGATIVE, static_cast<uint64_t>(-1 - value));
+            }
+        } else if (node.IsPureDouble()) {
+            // Дробные числа всегда занимают 8 байт: так при чтении
+            // они не превратятся в целые и не потеряют точность
+            const double value = node.AsDouble();
+            uint64_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            buffer_ += static_cast<char>(DOUBLE_BYTE);
+            WriteBigEndian(bits, sizeof(bits));
+        } else if (node.IsBool()) {
+            buffer_ += static_cast<char>(node.AsBool() ? TRUE_BYTE : FALSE_BYTE);
+        } else {
+            buffer_ += static_cast<char>(NULL_BYTE);
+        }
+    }
+
+private:
+    std::ostream& output_;
+    std::string buffer_;
+
+    void WriteBigEndian(uint64_t value, size_t size) {
+        for (size_t i = size; i-- > 0;) {
+            buffer_ += static_cast<char>((value >> (i * 8)) & 0xff);
+        }
+    }
+
+    // Аргумент записывается самым коротким из допустимых способов
+    void WriteHead(Major major, uint64_t argument) {
+        const uint8_t type = static_cast<uint8_t>(major << 5);
+        if (argument < DIRECT_LIMIT) {
+            buffer_ += static_cast<char>(type | argument);
+        } else if (argument <= UINT8_MAX) {
+            buffer_ += static_cast<char>(type | 24);
+            WriteBigEndian(argument, 1);
+        } else if (argument <= UINT16_MAX) {
+            buffer_ += static_cast<char>(type | 25);
+            WriteBigEndian(argument, 2);
+        } else if (argument <= UINT32_MAX) {
+            buffer_ += static_cast<char>(type | 26);
+            WriteBigEndian(argument, 4);
+        } else {
+            buffer_ += static_cast<char>(type | 27);
+            WriteBigEndian(argument, 8);
+        }
+    }
+
+    void WriteText(std::string_view text) {
+        WriteHead(TEXT, text.size());
+        buffer_ += text;
+    }
+};
+
+// Разбирает CBOR из непрерывного буфера. Поддерживается то, что пишет
+// BinaryWriter, а также 4-байтовые дробные числа. Элементы неизвестной
+// длины, байтовые строки и теги считаются ошибкой
+class BinaryParser {
+public:
+    explicit BinaryParser(std::string_view input)
+        : pos_(reinterpret_cast<const uint8_t*>(input.data()))
+        , end_(pos_ + input.size()) {
+    }
+
+    Node LoadDocument() {
+        Node root = LoadNode();
+        CheckFinished();
+        return root;
+    }
+
+    void ParseDocument(Handler& handler) {
+        ParseNode(handler);
+        CheckFinished();
+    }
+
+private:
+    struct Head {
+        uint8_t major;
+        uint8_t info;
+        uint64_t argument;
+    };
+
+    const uint8_t* pos_;
+    const uint8_t* end_;
+    std::vector<Dict::value_type> dict_stack_;
+
+    void Require(size_t size) const {
+        if (static_cast<size_t>(end_ - pos_) < size) {
+            throw ParsingError("Unexpected end of binary document"s);
+        }
+    }
+
+    void CheckFinished() const {
+        if (pos_ != end_) {
+            throw ParsingError("Unexpected data after binary document"s);
+        }
+    }
+
+    uint64_t ReadBigEndian(size_t size) {
+        Require(size);
+        uint64_t value = 0;
+        for (size_t i = 0; i < size; ++i) {
+            value = (value << 8) | pos_[i];
+        }
+        pos_ += size;
+        return value;
+    }
+
+    Head ReadHead() {
+        Require(1);
+        const uint8_t byte = *pos_++;
+        Head head{static_cast<uint8_t>(byte >> 5), static_cast<uint8_t>(byte & 0x1f), 0};
+        if (head.info < DIRECT_LIMIT) {
+            head.argument = head.info;
+        } else if (head.info <= 27) {
+            head.argument = ReadBigEndian(size_t{1} << (head.info - 24));
+        } else {
+            throw ParsingError("Unsupported binary item 0x"s + "0123456789abcdef"[byte >> 4] +
+                               "0123456789abcdef"[byte & 0xf]);
+        }
+        return head;
+    }
+
+    // Число элементов контейнера не может превышать остаток буфера:
+    // это отсекает испорченную длину раньше, чем под неё выделится память
+    size_t ReadCount(const Head& head) const {
+        if (head.argument > static_cast<uint64_t>(end_ - pos_)) {
+            throw ParsingError("Container is longer than binary document"s);
+        }
+        return static_cast<size_t>(head.argument);
+    }
+
+    std::string ReadText(const Head& head) {
+        if (head.major != TEXT) {
+            throw ParsingError("Text string is expected"s);
+        }
+        Require(head.argument);
+        std::string text(reinterpret_cast<const char*>(pos_), static_cast<size_t>(head.argument));
+        pos_ += head.argument;
+        return text;
+    }
+
+    // Целые, не помещающиеся в int, читаются как double, как и в тексте
+    static Node MakeInteger(const Head& head) {
+        if (head.major == UNSIGNED) {
+            if (head.argument <= INT_MAX) {
+                return Node{static_cast<int>(head.argument)};
+            }
+            return Node{static_cast<double>(head.argument)};
+        }
+        if (head.argument <= INT_MAX) {
+            return Node{-1 - static_cast<int>(head.argument)};
+        }
+        return Node{-1.0 - static_cast<double>(head.argument)};
+    }
+
+    static Node MakeSimple(const Head& head) {
+        switch (head.info) {
+            case FALSE_BYTE & 0x1f:
+                return Node{false};
+            case TRUE_BYTE & 0x1f:
+                return Node{true};
+            case NULL_BYTE & 0x1f:
+                return Node{nullptr};
+            case FLOAT_BYTE & 0x1f: {
+                const uint32_t bits = static_cast<uint32_t>(head.argument);
+                float value;
+                std::memcpy(&value, &bits, sizeof(value));
+                return Node{static_cast<double>(value)};
+            }
+            case DOUBLE_BYTE & 0x1f: {
+                double value;
+                std::memcpy(&value, &head.argument, sizeof(value));
+                return Node{value};
+            }
+        }
+        throw ParsingError("Unsupported binary simple value "s + std::to_string(head.info));
+    }
+
+    Node LoadScalar(const Head& head) {
+        switch (head.major) {
+            case UNSIGNED:
+            case NEGATIVE:
+                return MakeInteger(head);
+            case TEXT:
+                return Node{ReadText(head)};
+            case SIMPLE:
+                return MakeSimple(head);
+        }
+        throw ParsingError("Unsupported binary major type "s + std::to_string(head.major));
+    }
+
+    Node LoadNode() {
+        const Head head = ReadHead();
+        if (head.major == ARRAY) {
+            const size_t count = ReadCount(head);
+            Array array;
+            array.reserve(count);
+            for (size_t i = 0; i < count; ++i) {
+                array.push_back(LoadNode());
+            }
+            return Node{std::move(array)};
+        }
+        if (head.major == MAP) {
+            return LoadDict(ReadCount(head));
+        }
+        return LoadScalar(head);
+    }
+
+    // Ключи сортируются один раз, как в текстовом разборе
+    Node LoadDict(size_t count) {
+        const size_t first = dict_stack_.size();
+        for (size_t i = 0; i < count; ++i) {
+            std::string key = ReadText(ReadHead());
+            Node value = LoadNode();
+            dict_stack_.emplace_back(std::move(key), std::move(value));
+        }
+        const auto begin = dict_stack_.begin() + first;
+        std::sort(begin, dict_stack_.end(), [](const auto& lhs, const auto& rhs) {
+            return lhs.first < rhs.first;
+        });
+        const auto duplicate = std::adjacent_find(begin, dict_stack_.end(), [](const auto& lhs, const auto& rhs) {
+            return lhs.first == rhs.first;
+        });
+        if (duplicate != dict_stack_.end()) {
+            throw ParsingError("Duplicate key '"s + duplicate->first + "' have been found");
+        }
+        Dict dict(std::make_move_iterator(begin), std::make_move_iterator(dict_stack_.end()));
+        dict_stack_.resize(first);
+        return Node(std::move(dict));
+    }
+
+    void ParseNode(Handler& handler) {
+        const Head head = ReadHead();
+        if (head.major == ARRAY) {
+            const size_t count = ReadCount(head);
+            handler.StartArray();
+            for (size_t i = 0; i < count; ++i) {
+                ParseNode(handler);
+            }
+            handler.EndArray();
+        } else if (head.major == MAP) {
+            const size_t count = ReadCount(head);
+            handler.StartDict();
+            for (size_t i = 0; i < count; ++i) {
+                handler.Key(ReadText(ReadHead()));
+                ParseNode(handler);
+            }
+            handler.EndDict();
+        } else {
+            handler.Value(LoadScalar(head));
+        }
+    }
+};
+
+}  // namespace
+
+Document LoadBinary(std::string_view input) {
+    return Document{BinaryParser{input}.LoadDocument()};
+}
+
+void ParseBinary(std::string_view input, Handler& handler) {
+    BinaryParser{input}.ParseDocument(handler);
+}
+
+void PrintBinary(const Document& doc, std::ostream& output) {
+    BinaryWriter{output}.WriteNode(doc.GetRoot());
+}
+
+}  // namespace json
@@ -1,159 +1,142 @@
 #include "json_builder.h"
 
+#include <algorithm>
+#include <iterator>
+
 using namespace json;
 using namespace std;
 
-Builder::Builder() {
-  nodes_stack_.push_back(&root_);
+Builder::Builder() : Builder(pmr::get_default_resource()) {}
+
+Builder::Builder(pmr::memory_resource* resource) : resource_(resource) {
+  frames_.reserve(INITIAL_DEPTH);
+  items_.reserve(INITIAL_ITEMS);
+  values_.reserve(INITIAL_ITEMS);
 }
 
-DictItemContext Builder::StartDict() {
-  if (nodes_stack_.empty()) {
+void Builder::CheckValue() const {
+  if (done_) {
     throw logic_error("after build"s);
   }
+  if (!frames_.empty() && frames_.back().is_dict && !frames_.back().has_key) {
+    throw logic_error("key"s);
+  }
+}
+
+void Builder::Place(Node&& node) {
+  if (frames_.empty()) {
+    root_ = move(node);
+    done_ = true;
+  } else if (frames_.back().is_dict) {
+    items_.back().second = move(node);
+    frames_.back().has_key = false;
+  } else {
+    values_.push_back(move(node));
+  }
+}
 
-  Node* ptr = new Node{Dict{}};
-  nodes_stack_.push_back(ptr);
-  keys_.push_back(nullopt);
+DictItemContext Builder::StartDict() {
+  CheckValue();
+  frames_.push_back({true, items_.size()});
   return DictItemContext{*this};
 }
 
 ArrayItemContext Builder::StartArray() {
-  if (nodes_stack_.empty()) {
-    throw logic_error("after build"s);
-  }
-
-  Node* ptr = new Node{Array{}};
-  nodes_stack_.push_back(ptr);
+  CheckValue();
+  frames_.push_back({false, values_.size()});
   return ArrayItemContext{*this};
 }
 
 Builder& Builder::Key(string str) {
-  if (nodes_stack_.empty()) {
+  if (done_) {
     throw logic_error("after build"s);
   }
 
-  if (nodes_stack_.back()->IsDict()) {
-    if (keys_.back()) {
+  if (!frames_.empty() && frames_.back().is_dict) {
+    if (frames_.back().has_key) {
       throw logic_error("key"s);
-    } else {
-      keys_.back() = move(str);
     }
+    items_.emplace_back(move(str), Node{});
+    frames_.back().has_key = true;
   } else {
     throw std::logic_error("not a dict"s);
   }
   return *this;
 }
 
-Builder& Builder::Value(json::Node node) {
-  if (nodes_stack_.empty()) {
-    throw logic_error("after build"s);
-  }
-
-  if (nodes_stack_.back()->IsDict()) {
-    if (!keys_.back()) {
-      throw logic_error("key"s);
-    }
-
-    auto& value = nodes_stack_.back()->GetValue();
-    Dict& dict = get<Dict>(value);
-    dict[*keys_.back()] = move(node);
-    keys_.back() = nullopt;
-
-  } else if (nodes_stack_.back()->IsArray()) {
-    auto& value = nodes_stack_.back()->GetValue();
-    Array& array = get<Array>(value);
-    array.emplace_back(move(node));
-
-  } else if (node.IsDict()) {
-    auto& value = nodes_stack_.back()->GetValue();
-    value = move(node.AsDict());
-    nodes_stack_.pop_back();
-
-  } else if (node.IsArray()) {
-    auto& value = nodes_stack_.back()->GetValue();
-    value = move(node.AsArray());
-    nodes_stack_.pop_back();
-
-  } else if (node.IsString()) {
-    auto& value = nodes_stack_.back()->GetValue();
-    value = move(node.AsString());
-    nodes_stack_.pop_back();
-
-  } else if (node.IsPureDouble()) {
-    auto& value = nodes_stack_.back()->GetValue();
-    value = node.AsDouble();
-    nodes_stack_.pop_back();
-
-  } else if (node.IsInt()) {
-    auto& value = nodes_stack_.back()->GetValue();
-    value = node.AsInt();
-    nodes_stack_.pop_back();
-
-  } else if (node.IsBool()) {
-    auto& value = nodes_stack_.back()->GetValue();
-    value = node.AsBool();
-    nodes_stack_.pop_back();
-
-  } else if (node.IsNull()) {
-    auto& value = nodes_stack_.back()->GetValue();
-    value = nullptr;
-    nodes_stack_.pop_back();
-  }
+Builder& Builder::Value(json::Node&& node) {
+  CheckValue();
+  Place(move(node));
   return *this;
 }
 
 Builder& Builder::EndDict() {
-  if (nodes_stack_.empty()) {
+  if (done_) {
     throw logic_error("after build"s);
-  } else if (!nodes_stack_.back()->IsDict()) {
-    throw logic_error("EndDcit"s);
+  } else if (frames_.empty() || !frames_.back().is_dict) {
+    throw logic_error("EndDict"s);
+  } else if (frames_.back().has_key) {
+    throw logic_error("key"s);
   }
 
-  json::Node node = *nodes_stack_.back();
-  delete nodes_stack_.back();
-  nodes_stack_.pop_back();
-  keys_.pop_back();
-  Value(node);
+  // Из одинаковых ключей остаётся последний, как при присваивании
+  // через operator[]. Dict сохраняет первый, поэтому дубли убираются здесь
+  const auto first = items_.begin() + frames_.back().first;
+  auto by_key = [](const auto& lhs, const auto& rhs) {
+    return lhs.first < rhs.first;
+  };
+  if (!is_sorted(first, items_.end(), by_key)) {
+    stable_sort(first, items_.end(), by_key);
+  }
+  auto last = first;
+  for (auto it = first; it != items_.end(); ++it) {
+    if (last != first && prev(last)->first == it->first) {
+      *prev(last) = move(*it);
+    } else {
+      if (last != it) {
+        *last = move(*it);
+      }
+      ++last;
+    }
+  }
+  Dict dict(make_move_iterator(first), make_move_iterator(last), resource_);
+  items_.erase(first, items_.end());
+  frames_.pop_back();
+  Place(Node{move(dict)});
   return *this;
 }
 
 Builder& Builder::EndArray() {
-  if (nodes_stack_.empty()) {
+  if (done_) {
     throw logic_error("after build"s);
-  } else if (!nodes_stack_.back()->IsArray()) {
+  } else if (frames_.empty() || frames_.back().is_dict) {
     throw logic_error("EndArray"s);
   }
 
-  json::Node node = *nodes_stack_.back();
-  delete nodes_stack_.back();
-  nodes_stack_.pop_back();
-  Value(node);
+  const auto first = values_.begin() + frames_.back().first;
+  Array array(resource_);
+  array.reserve(values_.end() - first);
+  array.insert(array.end(), make_move_iterator(first),
+               make_move_iterator(values_.end()));
+  values_.erase(first, values_.end());
+  frames_.pop_back();
+  Place(Node{move(array)});
   return *this;
 }
 
 Node Builder::Build() {
-  if (!nodes_stack_.empty()) {
+  if (!done_) {
     throw logic_error("incomplete"s);
   }
 
-  return root_;
-}
-
-Builder::~Builder() {
-  if (nodes_stack_.size() > 1) {
-    for (size_t i = 0; i < nodes_stack_.size() - 1; ++i) {
-      if (nodes_stack_.back()) {
-        delete nodes_stack_.back();
-      }
-    }
-  }
+  // Узел забирается перемещением: копия потеряла бы арену builder'а
+  return move(root_);
 }
 
 DictItemContext::DictItemContext(Builder& builder) : builder_(builder) {}
 
 KeyItemContext DictItemContext::Key(std::string str) {
-  return KeyItemContext{builder_.Key(str)};
+  return KeyItemContext{builder_.Key(move(str))};
 }
 
 Builder& DictItemContext::EndDict() {
@@ -162,8 +145,8 @@ Builder& DictItemContext::EndDict() {
 
 KeyItemContext::KeyItemContext(Builder& builder) : builder_(builder) {}
 
-DictItemContext KeyItemContext::Value(json::Node node) {
-  return DictItemContext{builder_.Value(node)};
+DictItemContext KeyItemContext::Value(json::Node&& node) {
+  return DictItemContext{builder_.Value(move(node))};
 }
 
 DictItemContext KeyItemContext::StartDict() {
@@ -176,8 +159,8 @@ ArrayItemContext KeyItemContext::StartArray() {
 
 ArrayItemContext::ArrayItemContext(Builder& builder) : builder_(builder) {}
 
-ArrayItemContext ArrayItemContext::Value(json::Node node) {
-  return ArrayItemContext{builder_.Value(node)};
+ArrayItemContext ArrayItemContext::Value(json::Node&& node) {
+  return ArrayItemContext{builder_.Value(move(node))};
 }
 
 DictItemContext ArrayItemContext::StartDict() {
@@ -1,75 +1,269 @@
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <memory_resource>
+#include <optional>
 #include <set>
+#include <sstream>
+#include <stdexcept>
 #include <vector>
 
 #include "json_reader.h"
 
 using namespace std;
 
-JsonReader::JsonReader(RequestHandler& handler, istream& input)
-    : handler_(handler), requests_(json::Load(input)) {
-  EnterData(requests_.GetRoot());
-}
+// Собирает запросы из потока событий разбора. Элементы base_requests
+// обрабатываются по одному, как только закончится их разбор, остальные
+// разделы собираются в дерево целиком. Порядок элементов не важен:
+// ещё не встреченные остановки каталог разрешит при заморозке
+class JsonReader::RequestsHandler final : public json::Handler {
+ public:
+  explicit RequestsHandler(JsonReader& reader) : reader_(reader) {}
 
-void JsonReader::Print(ostream& output) {
-  json::Print(GetJsonAnswers(), output);
-}
+  void StartDict() override {
+    if (depth_ != 0) {
+      StartValue();
+      builder_->StartDict();
+    }
+    ++depth_;
+  }
 
-void JsonReader::EnterData(const json::Node& node) {
-  for (const auto& [type_requests, node_tmp] : node.AsDict()) {
-    if (type_requests == "base_requests"s) {
-      AddStop(node_tmp);
-      AddDistance(node_tmp);
-      AddRoute(node_tmp);
-    } else if (type_requests == "render_settings"s) {
-      SetRendererSettings(node_tmp);
+  void Key(string key) override {
+    if (depth_ == 1) {
+      section_ = move(key);
+    } else {
+      builder_->Key(move(key));
     }
   }
-}
 
-void JsonReader::AddStop(const json::Node& node_base_requests) {
-  for (const json::Node& node_base_request : node_base_requests.AsArray()) {
-    const json::Dict& map_base_request = node_base_request.AsDict();
-    if (map_base_request.at("type"s).AsString() == "Stop"s) {
-      const string& name = map_base_request.at("name"s).AsString();
-      double latitude = map_base_request.at("latitude"s).AsDouble();
-      double longitude = map_base_request.at("longitude"s).AsDouble();
-      Coordinates coord{latitude, longitude};
-      handler_.AddStop(name, coord);
+  void EndDict() override {
+    --depth_;
+    if (depth_ != 0) {
+      builder_->EndDict();
+      FinishValue();
     }
   }
-}
 
-void JsonReader::AddDistance(const json::Node& node_base_requests) {
-  for (const json::Node& node_base_request : node_base_requests.AsArray()) {
-    const json::Dict& map_base_request = node_base_request.AsDict();
-    if (map_base_request.at("type"s).AsString() == "Stop"s) {
+  void StartArray() override {
+    if (depth_ == 0) {
+      throw logic_error("Not a dict"s);
+    }
+    if (depth_ == 1 && section_ == "base_requests"s) {
+      streaming_ = true;
+    } else {
+      StartValue();
+      builder_->StartArray();
+    }
+    ++depth_;
+  }
+
+  void EndArray() override {
+    --depth_;
+    if (depth_ == 1 && streaming_) {
+      streaming_ = false;
+    } else {
+      builder_->EndArray();
+      FinishValue();
+    }
+  }
+
+  void Value(json::Node value) override {
+    if (depth_ == 0) {
+      throw logic_error("Not a dict"s);
+    }
+    StartValue();
+    builder_->Value(move(value));
+    FinishValue();
+  }
+
+  void Finish() {
+    reader_.requests_ =
+        json::Document{json::Node{move(sections_)}, move(sections_arena_)};
+  }
+
+ private:
+  JsonReader& reader_;
+  int depth_ = 0;
+  bool streaming_ = false;
+  string section_;
+  optional<json::Builder> builder_;
+  // Разделы документа живут в арене вместе с ним. Очередной элемент
+  // base_requests живёт только до своей обработки, поэтому память под него
+  // берётся из отдельной арены и возвращается ей целиком
+  unique_ptr<pmr::monotonic_buffer_resource> sections_arena_ =
+      make_unique<pmr::monotonic_buffer_resource>();
+  pmr::monotonic_buffer_resource element_arena_;
+  json::Dict sections_{sections_arena_.get()};
+
+  // Глубина, на которой лежат целиком собираемые значения
+  int ValueDepth() const {
+    return streaming_ ? 2 : 1;
+  }
+
+  void StartValue() {
+    if (depth_ == ValueDepth()) {
+      builder_.emplace(streaming_ ? &element_arena_ : sections_arena_.get());
+    }
+  }
+
+  void FinishValue() {
+    if (depth_ != ValueDepth()) {
+      return;
+    }
+    if (streaming_) {
+      AddBaseRequest(builder_->Build().AsDict());
+      builder_.reset();
+      element_arena_.release();
+    } else {
+      sections_[section_] = builder_->Build();
+      builder_.reset();
+    }
+  }
+
+  void AddBaseRequest(const json::Dict& map_base_request) {
+    const string& type = map_base_request.at("type"s).AsString();
+    if (type == "Stop"s) {
+      reader_.AddStop(map_base_request);
       const string& name = map_base_request.at("name"s).AsString();
       const auto iter = map_base_request.find("road_distances"s);
       if (iter != map_base_request.end()) {
-        const json::Node& node_stops_dist = iter->second;
-        for (const auto& [stop, distance] : node_stops_dist.AsDict()) {
-          pair<string, string> stops{name, stop};
-          handler_.SetDistance(stops, distance.AsInt());
+        for (const auto& [stop, distance] : iter->second.AsDict()) {
+          reader_.handler_.SetDistance(name, stop, distance.AsInt());
         }
       }
+    } else if (type == "Bus"s) {
+      vector<string> stops;
+      for (const json::Node& node_stop :
+           map_base_request.at("stops"s).AsArray()) {
+        stops.push_back(node_stop.AsString());
+      }
+      reader_.handler_.AddRoute(map_base_request.at("name"s).AsString(),
+                                move(stops),
+                                map_base_request.at("is_roundtrip"s).AsBool());
     }
   }
+};
+
+JsonReader::JsonReader(RequestHandler& handler, istream& input)
+    : handler_(handler), requests_(json::Node{nullptr}) {
+  RequestsHandler events(*this);
+  // Первый байт остаётся в потоке и достанется разбору
+  if (json::IsBinary(input.peek())) {
+    json::ParseBinary(input, events);
+  } else {
+    json::Parse(input, events);
+  }
+  events.Finish();
+  EnterData(requests_.GetRoot());
+  handler_.Freeze();
 }
 
-void JsonReader::AddRoute(const json::Node& node_base_requests) {
-  for (const json::Node& node_base_request : node_base_requests.AsArray()) {
-    const json::Dict& map_base_request = node_base_request.AsDict();
-    vector<string> stops;
-    if (map_base_request.at("type"s).AsString() == "Bus"s) {
-      const string& name = map_base_request.at("name"s).AsString();
-      for (const json::Node& node_stop :
-           map_base_request.at("stops"s).AsArray()) {
-        stops.push_back(node_stop.AsString());
+JsonReader::JsonReader(RequestHandler& handler, string_view input)
+    : handler_(handler), requests_(json::Node{nullptr}) {
+  RequestsHandler events(*this);
+  if (!input.empty() && json::IsBinary(static_cast<unsigned char>(input.front()))) {
+    json::ParseBinary(input, events);
+  } else {
+    json::Parse(input, events);
+  }
+  events.Finish();
+  EnterData(requests_.GetRoot());
+  handler_.Freeze();
+}
+
+// Ответы пишутся в поток по одному, без промежуточного дерева узлов
+void JsonReader::Print(ostream& output) {
+  json::StreamBuilder out(output);
+  // Иерархия сжатий нужна только запросам Distance. Если её нет в базе,
+  // она строится при первом из них
+  optional<transport::RoadRouter> router;
+  out.StartArray();
+  for (const auto& [type_requests, node_state_requests] :
+       requests_.GetRoot().AsDict()) {
+    if (type_requests != "stat_requests"s) {
+      continue;
+    }
+    for (const json::Node& node_state_request : node_state_requests.AsArray()) {
+      const json::Dict& map_state_request = node_state_request.AsDict();
+      const string& type = map_state_request.at("type"sv).AsString();
+      if (type == "Stop"s) {
+        PrintStop(out, map_state_request);
+      } else if (type == "Bus"s) {
+        PrintBus(out, map_state_request);
+      } else if (type == "Map"s) {
+        PrintMap(out, map_state_request);
+      } else if (type == "NearestStops"s) {
+        PrintNearestStops(out, map_state_request);
+      } else if (type == "StopsInBox"s) {
+        PrintStopsInBox(out, map_state_request);
+      } else if (type == "Distance"s) {
+        if (!router) {
+          router.emplace(handler_.GetSnapshot());
+        }
+        PrintDistance(out, map_state_request, *router);
       }
-      bool is_roundtrip = map_base_request.at("is_roundtrip"s).AsBool();
-      handler_.AddRoute(name, move(stops), is_roundtrip);
     }
   }
+  out.EndArray();
+  out.Finish();
+}
+
+const string& JsonReader::GetBaseFile() const {
+  return requests_.GetRoot()
+      .AsDict()
+      .at("serialization_settings"sv)
+      .AsDict()
+      .at("file"sv)
+      .AsString();
+}
+
+// Настройки отрисовки хранятся в файле в виде CBOR, как пришли в запросе
+void JsonReader::SaveBase() {
+  ostringstream settings;
+  const json::Dict& sections = requests_.GetRoot().AsDict();
+  if (const auto iter = sections.find("render_settings"sv);
+      iter != sections.end()) {
+    json::PrintBinary(json::Document{iter->second}, settings);
+  }
+  const string& path = GetBaseFile();
+  ofstream output(path, ios::binary);
+  if (!output) {
+    throw runtime_error("can't create "s + path);
+  }
+  // Иерархия сжатий строится один раз здесь, а не при каждом запуске
+  // process_requests
+  const transport::Snapshot& snapshot = handler_.GetSnapshot();
+  const transport::Snapshot::Hierarchy hierarchy =
+      transport::ContractRoads(snapshot);
+  snapshot.Save(output, settings.str(), &hierarchy);
+  output.close();
+  if (!output) {
+    throw runtime_error("can't write "s + path);
+  }
+}
+
+void JsonReader::LoadBase() {
+  auto snapshot = transport::Snapshot::Load(GetBaseFile());
+  if (!snapshot->Settings().empty()) {
+    SetRendererSettings(json::LoadBinary(snapshot->Settings()).GetRoot());
+  }
+  handler_.SetSnapshot(move(snapshot));
+}
+
+void JsonReader::EnterData(const json::Node& node) {
+  for (const auto& [type_requests, node_tmp] : node.AsDict()) {
+    if (type_requests == "render_settings"s) {
+      SetRendererSettings(node_tmp);
+    }
+  }
+}
+
+void JsonReader::AddStop(const json::Dict& map_base_request) {
+  const string& name = map_base_request.at("name"s).AsString();
+  double latitude = map_base_request.at("latitude"s).AsDouble();
+  double longitude = map_base_request.at("longitude"s).AsDouble();
+  Coordinates coord{latitude, longitude};
+  handler_.AddStop(name, coord);
 }
 
 svg::Color Conver2Color(const json::Node& node) {
@@ -140,97 +334,147 @@ void JsonReader::SetRendererSettings(const json::Node& node_render_settings) {
   handler_.SetRendererSettings(settings);
 }
 
-json::Node JsonReader::GetNodeBus(const json::Dict& map_state_request) {
-  const string& name = map_state_request.at("name"s).AsString();
-  int request_id = map_state_request.at("id"s).AsInt();
-  Bus* bus_ptr = handler_.GetBusData(name);
-  if (bus_ptr != nullptr) {
-    return json::Builder{}
-        .StartDict()
-        .Key("curvature"s)
-        .Value(bus_ptr->curvature)
-        .Key("request_id"s)
+void JsonReader::PrintBus(json::StreamBuilder& out,
+                          const json::Dict& map_state_request) {
+  const string& name = map_state_request.at("name"sv).AsString();
+  int request_id = map_state_request.at("id"sv).AsInt();
+  const transport::Snapshot& snapshot = handler_.GetSnapshot();
+  if (const auto bus = snapshot.FindBus(name)) {
+    const transport::Snapshot::BusStats& stats = snapshot.GetBusStats(*bus);
+    out.StartDict()
+        .Key("curvature"sv)
+        .Value(stats.curvature)
+        .Key("request_id"sv)
         .Value(request_id)
-        .Key("route_length"s)
-        .Value(double(bus_ptr->routeLength))
-        .Key("stop_count"s)
-        .Value(bus_ptr->stopsOnRoute)
-        .Key("unique_stop_count"s)
-        .Value(bus_ptr->uniqueStops)
-        .EndDict()
-        .Build();
+        .Key("route_length"sv)
+        .Value(stats.route_length)
+        .Key("stop_count"sv)
+        .Value(stats.stop_count)
+        .Key("unique_stop_count"sv)
+        .Value(stats.unique_stop_count)
+        .EndDict();
 
   } else {
-    return json::Builder{}
-        .StartDict()
-        .Key("request_id"s)
-        .Value(request_id)
-        .Key("error_message"s)
-        .Value("not found"s)
-        .EndDict()
-        .Build();
-  }
-}
-
-json::Node JsonReader::GetNodeStop(const json::Dict& map_state_request) {
-  const string& name = map_state_request.at("name"s).AsString();
-  Stop* stop_ptr = handler_.GetStopData(name);
-  int request_id = map_state_request.at("id"s).AsInt();
-  if (stop_ptr != nullptr) {
-    const set<string>& buses = stop_ptr->buses;
-    return json::Builder{}
-        .StartDict()
-        .Key("buses"s)
-        .Value(json::Array{buses.begin(), buses.end()})
-        .Key("request_id"s)
-        .Value(request_id)
-        .EndDict()
-        .Build();
+    PrintNotFound(out, request_id);
+  }
+}
 
-  } else {
-    return json::Builder{}
-        .StartDict()
-        .Key("request_id"s)
-        .Value(request_id)
-        .Key("error_message"s)
-        .Value("not found"s)
-        .EndDict()
-        .Build();
-  }
-}
-
-json::Document JsonReader::GetJsonAnswers() {
-  json::Array nodes;
-  const json::Node& node_dict = requests_.GetRoot();
-  for (const auto& [type_requests, node_state_requests] : node_dict.AsDict()) {
-    if (type_requests == "stat_requests"s) {
-      for (const json::Node& node_state_request :
-           node_state_requests.AsArray()) {
-        const json::Dict& map_state_request = node_state_request.AsDict();
-        if (map_state_request.at("type"s).AsString() == "Stop"s) {
-          nodes.push_back(GetNodeStop(map_state_request));
-        } else if (map_state_request.at("type"s).AsString() == "Bus"s) {
-          nodes.push_back(GetNodeBus(map_state_request));
-        } else if (map_state_request.at("type"s).AsString() == "Map"s) {
-          ostringstream out;
-          svg::Document doc = handler_.RenderMap();
-          doc.Render(out);
-          int request_id = map_state_request.at("id"s).AsInt();
-          string str = out.str();
-          if (str[str.size() - 1] == '\n') {
-            str.resize(str.size() - 1);
-          }
-          nodes.push_back(json::Builder{}
-                              .StartDict()
-                              .Key("map"s)
-                              .Value(str)
-                              .Key("request_id"s)
-                              .Value(request_id)
-                              .EndDict()
-                              .Build());
-        }
-      }
+void JsonReader::PrintStop(json::StreamBuilder& out,
+                           const json::Dict& map_state_request) {
+  const string& name = map_state_request.at("name"sv).AsString();
+  int request_id = map_state_request.at("id"sv).AsInt();
+  const transport::Snapshot& snapshot = handler_.GetSnapshot();
+  if (const auto stop = snapshot.FindStop(name)) {
+    auto buses = out.StartDict().Key("buses"sv).StartArray();
+    for (BusId bus : snapshot.StopBuses(*stop)) {
+      buses.Value(snapshot.BusName(bus));
     }
+    buses.EndArray().Key("request_id"sv).Value(request_id).EndDict();
+
+  } else {
+    PrintNotFound(out, request_id);
+  }
+}
+
+void JsonReader::PrintMap(json::StreamBuilder& out,
+                          const json::Dict& map_state_request) {
+  ostringstream svg_out;
+  handler_.RenderMap().Render(svg_out);
+  const string str = svg_out.str();
+  string_view map = str;
+  if (!map.empty() && map.back() == '\n') {
+    map.remove_suffix(1);
   }
-  return json::Document{json::Node{nodes}};
+  out.StartDict()
+      .Key("map"sv)
+      .Value(map)
+      .Key("request_id"sv)
+      .Value(map_state_request.at("id"sv).AsInt())
+      .EndDict();
+}
+
+void JsonReader::PrintNearestStops(json::StreamBuilder& out,
+                                   const json::Dict& map_state_request) {
+  const Coordinates from(map_state_request.at("latitude"sv).AsDouble(),
+                         map_state_request.at("longitude"sv).AsDouble());
+  const int count = map_state_request.at("count"sv).AsInt();
+  const transport::Snapshot& snapshot = handler_.GetSnapshot();
+  auto stops = out.StartDict()
+                   .Key("request_id"sv)
+                   .Value(map_state_request.at("id"sv).AsInt())
+                   .Key("stops"sv)
+                   .StartArray();
+  for (const auto& [stop, distance] :
+       snapshot.NearestStops(from, max(count, 0))) {
+    stops.StartDict()
+        .Key("distance"sv)
+        .Value(distance)
+        .Key("name"sv)
+        .Value(snapshot.StopName(stop))
+        .EndDict();
+  }
+  stops.EndArray().EndDict();
+}
+
+// Остановки выводятся по алфавиту
+void JsonReader::PrintStopsInBox(json::StreamBuilder& out,
+                                 const json::Dict& map_state_request) {
+  const Coordinates min(map_state_request.at("min_latitude"sv).AsDouble(),
+                        map_state_request.at("min_longitude"sv).AsDouble());
+  const Coordinates max(map_state_request.at("max_latitude"sv).AsDouble(),
+                        map_state_request.at("max_longitude"sv).AsDouble());
+  const transport::Snapshot& snapshot = handler_.GetSnapshot();
+  vector<string_view> names;
+  for (StopId stop : snapshot.StopsInBox(min, max)) {
+    names.push_back(snapshot.StopName(stop));
+  }
+  sort(names.begin(), names.end());
+  auto stops = out.StartDict()
+                   .Key("request_id"sv)
+                   .Value(map_state_request.at("id"sv).AsInt())
+                   .Key("stops"sv)
+                   .StartArray();
+  for (string_view name : names) {
+    stops.Value(name);
+  }
+  stops.EndArray().EndDict();
+}
+
+void JsonReader::PrintDistance(json::StreamBuilder& out,
+                               const json::Dict& map_state_request,
+                               transport::RoadRouter& router) {
+  const int request_id = map_state_request.at("id"sv).AsInt();
+  const transport::Snapshot& snapshot = handler_.GetSnapshot();
+  const auto from =
+      snapshot.FindStop(map_state_request.at("from"sv).AsString());
+  const auto to = snapshot.FindStop(map_state_request.at("to"sv).AsString());
+  optional<transport::RoadRouter::Route> route;
+  if (from && to) {
+    route = router.FindRoute(*from, *to);
+  }
+  if (!route) {
+    PrintNotFound(out, request_id);
+    return;
+  }
+  auto stops = out.StartDict()
+                   .Key("distance"sv)
+                   .Value(route->distance)
+                   .Key("request_id"sv)
+                   .Value(request_id)
+                   .Key("stops"sv)
+                   .StartArray();
+  for (StopId stop : route->stops) {
+    stops.Value(snapshot.StopName(stop));
+  }
+  stops.EndArray().EndDict();
+}
+
+// Ключи пишутся по алфавиту, как их расставил бы json::Dict
+void JsonReader::PrintNotFound(json::StreamBuilder& out, int request_id) {
+  out.StartDict()
+      .Key("error_message"sv)
+      .Value("not found"sv)
+      .Key("request_id"sv)
+      .Value(request_id)
+      .EndDict();
 }
@@ -0,0 +1,84 @@
+#include "json_stream_builder.h"
+
+#include <stdexcept>
+
+using namespace json;
+using namespace std;
+
+StreamBuilder::StreamBuilder(ostream& output, PrintSettings settings)
+    : writer_(output, settings) {}
+
+void StreamBuilder::BeforeValue() {
+  if (done_) {
+    throw logic_error("after build"s);
+  }
+  if (!levels_.empty()) {
+    Level& level = levels_.back();
+    if (level.is_dict && !level.has_key) {
+      throw logic_error("key"s);
+    }
+    level.has_key = false;
+  }
+}
+
+void StreamBuilder::AfterValue() {
+  if (levels_.empty()) {
+    done_ = true;
+  }
+}
+
+StreamBuilder::DictContext StreamBuilder::StartDict() {
+  BeforeValue();
+  writer_.StartDict();
+  levels_.push_back({true});
+  return DictContext{*this};
+}
+
+StreamBuilder::ArrayContext StreamBuilder::StartArray() {
+  BeforeValue();
+  writer_.StartArray();
+  levels_.push_back({false});
+  return ArrayContext{*this};
+}
+
+StreamBuilder& StreamBuilder::Key(string_view key) {
+  if (levels_.empty() || !levels_.back().is_dict) {
+    throw logic_error("not a dict"s);
+  }
+  if (levels_.back().has_key) {
+    throw logic_error("key"s);
+  }
+  levels_.back().has_key = true;
+  writer_.Key(key);
+  return *this;
+}
+
+StreamBuilder& StreamBuilder::EndDict() {
+  if (levels_.empty() || !levels_.back().is_dict) {
+    throw logic_error("not a dict"s);
+  }
+  if (levels_.back().has_key) {
+    throw logic_error("key"s);
+  }
+  levels_.pop_back();
+  writer_.EndDict();
+  AfterValue();
+  return *this;
+}
+
+StreamBuilder& StreamBuilder::EndArray() {
+  if (levels_.empty() || levels_.back().is_dict) {
+    throw logic_error("not an array"s);
+  }
+  levels_.pop_back();
+  writer_.EndArray();
+  AfterValue();
+  return *this;
+}
+
+void StreamBuilder::Finish() {
+  if (!done_) {
+    throw logic_error("not finished"s);
+  }
+  writer_.Flush();
+}
@@ -0,0 +1,206 @@
+#include "json_writer.h"
+
+#include <charconv>
+
+using namespace std::literals;
+
+namespace json {
+
+namespace {
+
+// Буфер сбрасывается, когда в нём накопится столько байт
+constexpr size_t FLUSH_SIZE = size_t{1} << 16;
+constexpr size_t INDENT_STEP = 4;
+constexpr std::string_view SPACES = "                                                                "sv;
+
+}  // namespace
+
+Writer::Writer(std::ostream& output, PrintSettings settings)
+    : output_(output)
+    , settings_(settings) {
+    buffer_.reserve(FLUSH_SIZE + FLUSH_SIZE / 4);
+}
+
+Writer::~Writer() {
+    Flush();
+}
+
+void Writer::Flush() {
+    output_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+    buffer_.clear();
+}
+
+void Writer::FlushIfFull() {
+    if (buffer_.size() >= FLUSH_SIZE) {
+        Flush();
+    }
+}
+
+void Writer::WriteIndent(size_t indent) {
+    while (indent > SPACES.size()) {
+        buffer_ += SPACES;
+        indent -= SPACES.size();
+    }
+    buffer_.append(SPACES.data(), indent);
+}
+
+// Начинает очередной элемент контейнера: запятая и отступ
+void Writer::NextItem() {
+    Level& level = levels_.back();
+    if (level.count++ != 0) {
+        buffer_ += settings_.compact ? ","sv : ",\n"sv;
+    }
+    if (!settings_.compact) {
+        WriteIndent(levels_.size() * INDENT_STEP);
+    }
+}
+
+// Значение в словаре уже предварено ключом, а в массиве начинает элемент
+void Writer::BeforeValue() {
+    FlushIfFull();
+    if (!levels_.empty() && !levels_.back().is_dict) {
+        NextItem();
+    }
+}
+
+void Writer::Close(char bracket) {
+    levels_.pop_back();
+    if (!settings_.compact) {
+        buffer_ += '\n';
+        WriteIndent(levels_.size() * INDENT_STEP);
+    }
+    buffer_ += bracket;
+}
+
+void Writer::StartDict() {
+    BeforeValue();
+    buffer_ += settings_.compact ? "{"sv : "{\n"sv;
+    levels_.push_back({true});
+}
+
+void Writer::Key(std::string_view key) {
+    FlushIfFull();
+    NextItem();
+    WriteString(key);
+    buffer_ += settings_.compact ? ":"sv : ": "sv;
+}
+
+void Writer::EndDict() {
+    Close('}');
+}
+
+void Writer::StartArray() {
+    BeforeValue();
+    buffer_ += settings_.compact ? "["sv : "[\n"sv;
+    levels_.push_back({false});
+}
+
+void Writer::EndArray() {
+    Close(']');
+}
+
+void Writer::Value(std::nullptr_t) {
+    BeforeValue();
+    buffer_ += "null"sv;
+}
+
+void Writer::Value(bool value) {
+    BeforeValue();
+    buffer_ += value ? "true"sv : "false"sv;
+}
+
+void Writer::Value(int value) {
+    BeforeValue();
+    char digits[16];
+    const auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    buffer_.append(digits, result.ptr);
+}
+
+void Writer::Value(uint64_t value) {
+    BeforeValue();
+    char digits[24];
+    const auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    buffer_.append(digits, result.ptr);
+}
+
+void Writer::Value(double value) {
+    BeforeValue();
+    char digits[32];
+    // По умолчанию 6 значащих цифр, как у std::ostream,
+    // иначе кратчайшая запись, читающаяся обратно в то же число.
+    // Целое значение получает ".0", чтобы не прочитаться как int
+    const auto result = settings_.exact_doubles
+                            ? std::to_chars(digits, digits + sizeof(digits), value)
+                            : std::to_chars(digits, digits + sizeof(digits), value,
+                                            std::chars_format::general, 6);
+    buffer_.append(digits, result.ptr);
+    if (settings_.exact_doubles &&
+        std::string_view(digits, result.ptr - digits).find_first_of(".en"sv) ==
+            std::string_view::npos) {
+        buffer_ += ".0"sv;
+    }
+}
+
+void Writer::Value(std::string_view value) {
+    BeforeValue();
+    WriteString(value);
+}
+
+void Writer::WriteString(std::string_view value) {
+    buffer_ += '"';
+    // Отрезки без спецсимволов копируются целиком
+    size_t run = 0;
+    for (size_t i = 0; i < value.size(); ++i) {
+        std::string_view escaped;
+        switch (value[i]) {
+            case '\r':
+                escaped = "\\r"sv;
+                break;
+            case '\n':
+                escaped = "\\n"sv;
+                break;
+            case '"':
+                escaped = "\\\""sv;
+                break;
+            case '\\':
+                escaped = "\\\\"sv;
+                break;
+            default:
+                continue;
+        }
+        buffer_.append(value.data() + run, i - run);
+        buffer_ += escaped;
+        run = i + 1;
+    }
+    buffer_.append(value.data() + run, value.size() - run);
+    buffer_ += '"';
+}
+
+void Writer::Value(const Node& node) {
+    if (node.IsDict()) {
+        StartDict();
+        for (const auto& [key, value] : node.AsDict()) {
+            Key(key);
+            Value(value);
+        }
+        EndDict();
+    } else if (node.IsArray()) {
+        StartArray();
+        for (const Node& value : node.AsArray()) {
+            Value(value);
+        }
+        EndArray();
+    } else if (node.IsString()) {
+        Value(std::string_view{node.AsString()});
+    } else if (node.IsInt()) {
+        Value(node.AsInt());
+    } else if (node.IsPureDouble()) {
+        Value(node.AsDouble());
+    } else if (node.IsBool()) {
+        Value(node.AsBool());
+    } else {
+        Value(nullptr);
+    }
+}
+
+}  // namespace json
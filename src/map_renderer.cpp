@@ -16,12 +16,12 @@ svg::Point SphereProjector::operator()(Coordinates coords) const {
           (max_lat_ - coords.lat) * zoom_coeff_ + padding_};
 }
 
-svg::Document MapRenderer::RenderMap() {
+svg::Document MapRenderer::RenderMap(const transport::Snapshot& snapshot) {
   vector<Coordinates> coords;
-  coords.reserve(stop_ptrs_.size());
-  for (const auto& [name, stop_ptr] : stop_ptrs_) {
-    if (!stop_ptr->buses.empty()) {
-      coords.push_back(stop_ptr->coord);
+  coords.reserve(snapshot.StopCount());
+  for (StopId stop : snapshot.StopsByName()) {
+    if (!snapshot.StopBuses(stop).empty()) {
+      coords.push_back(snapshot.StopCoordinates(stop));
     }
   }
   SphereProjector sphere_projector(coords.begin(), coords.end(),
@@ -30,10 +30,10 @@ svg::Document MapRenderer::RenderMap() {
 
   svg::Document doc;
 
-  RenderLinesBetweenStops(doc, sphere_projector);
-  RenderRouteNames(doc, sphere_projector);
-  RenderStopSymbol(doc, sphere_projector);
-  RenderStopNames(doc, sphere_projector);
+  RenderLinesBetweenStops(doc, snapshot, sphere_projector);
+  RenderRouteNames(doc, snapshot, sphere_projector);
+  RenderStopSymbol(doc, snapshot, sphere_projector);
+  RenderStopNames(doc, snapshot, sphere_projector);
 
   return doc;
 }
@@ -42,20 +42,14 @@ void MapRenderer::SetRendererSettings(const RenderSettings& settings) {
   settings_ = settings;
 }
 
-void MapRenderer::SetRoute(const string& number, Route&& route) {
-  bus_ptrs_[number] = move(route);
-}
-
-void MapRenderer::SetCoordinates(const string& name, Stop* stop_ptr) {
-  stop_ptrs_[name] = stop_ptr;
-}
-
 void MapRenderer::RenderLinesBetweenStops(
     svg::Document& doc,
+    const transport::Snapshot& snapshot,
     const SphereProjector& sphere_projector) {
   vector<svg::Color>::iterator iter_color = settings_.color_palette.begin();
-  for (const auto& [number, route] : bus_ptrs_) {
-    if (!route.bus->stops.empty()) {
+  for (BusId bus : snapshot.BusesByName()) {
+    const RouteView stops = snapshot.BusStops(bus);
+    if (!stops.empty()) {
       svg::Polyline line;
       line.SetFillColor(svg::NoneColor);
       line.SetStrokeWidth(settings_.line_width);
@@ -68,9 +62,8 @@ void MapRenderer::RenderLinesBetweenStops(
         iter_color = settings_.color_palette.begin();
       }
 
-      for (const string& stop : route.bus->stops) {
-        Stop* stop_ptr = stop_ptrs_.at(stop);
-        svg::Point point = sphere_projector(stop_ptr->coord);
+      for (StopId stop : stops) {
+        svg::Point point = sphere_projector(snapshot.StopCoordinates(stop));
         line.AddPoint(point);
       }
 
@@ -79,25 +72,35 @@ void MapRenderer::RenderLinesBetweenStops(
   }
 }
 
+// Конечная - последняя остановка в прямом направлении
 void MapRenderer::RenderRouteNames(svg::Document& doc,
+                                   const transport::Snapshot& snapshot,
                                    const SphereProjector& sphere_projector) {
   vector<svg::Color>::iterator iter_color = settings_.color_palette.begin();
-  for (const auto& [number, route] : bus_ptrs_) {
-    if (!route.bus->stops.empty()) {
+  for (BusId bus : snapshot.BusesByName()) {
+    const RouteView stops = snapshot.BusStops(bus);
+    if (!stops.empty()) {
+      const StopId first_stop = stops.front();
+      const StopId last_stop = stops[stops.ForwardSize() - 1];
+      const string_view number = snapshot.BusName(bus);
       svg::Text text_underlay;
       svg::Text text;
       SetDefaultSettingsRouteName(text_underlay, text);
       SetColor(text, iter_color);
       SetName(text_underlay, number);
       SetName(text, number);
-      SetPositionStop(text_underlay, route.first_stop, sphere_projector);
-      SetPositionStop(text, route.first_stop, sphere_projector);
+      SetPositionStop(text_underlay, snapshot.StopCoordinates(first_stop),
+                      sphere_projector);
+      SetPositionStop(text, snapshot.StopCoordinates(first_stop),
+                      sphere_projector);
       doc.Add(text_underlay);
       doc.Add(text);
 
-      if (route.first_stop != route.last_stop) {
-        SetPositionStop(text_underlay, route.last_stop, sphere_projector);
-        SetPositionStop(text, route.last_stop, sphere_projector);
+      if (first_stop != last_stop) {
+        SetPositionStop(text_underlay, snapshot.StopCoordinates(last_stop),
+                        sphere_projector);
+        SetPositionStop(text, snapshot.StopCoordinates(last_stop),
+                        sphere_projector);
         doc.Add(text_underlay);
         doc.Add(text);
       }
@@ -131,24 +134,17 @@ void MapRenderer::SetColor(svg::Text& text,
   }
 }
 
-void MapRenderer::SetName(svg::Text& text, const string& name) {
-  text.SetData(name);
-}
-
-void MapRenderer::SetPositionStop(svg::Text& text,
-                                  const string& stop,
-                                  const SphereProjector& sphere_projector) {
-  const Stop* stop_ptr = stop_ptrs_.at(stop);
-  svg::Point point = sphere_projector(stop_ptr->coord);
-  text.SetPosition(point);
+void MapRenderer::SetName(svg::Text& text, string_view name) {
+  text.SetData(string(name));
 }
 
 void MapRenderer::RenderStopSymbol(svg::Document& doc,
+                                   const transport::Snapshot& snapshot,
                                    const SphereProjector& sphere_projector) {
-  for (const auto& [name, stop_ptr] : stop_ptrs_) {
-    if (!stop_ptr->buses.empty()) {
+  for (StopId stop : snapshot.StopsByName()) {
+    if (!snapshot.StopBuses(stop).empty()) {
       svg::Circle circle;
-      svg::Point point = sphere_projector(stop_ptr->coord);
+      svg::Point point = sphere_projector(snapshot.StopCoordinates(stop));
       circle.SetCenter(point);
       circle.SetRadius(settings_.stop_radius);
       circle.SetFillColor("white"s);
@@ -158,16 +154,18 @@ void MapRenderer::RenderStopSymbol(svg::Document& doc,
 }
 
 void MapRenderer::RenderStopNames(svg::Document& doc,
+                                  const transport::Snapshot& snapshot,
                                   const SphereProjector& sphere_projector) {
-  for (const auto& [name, stop_ptr] : stop_ptrs_) {
-    if (!stop_ptr->buses.empty()) {
+  for (StopId stop : snapshot.StopsByName()) {
+    if (!snapshot.StopBuses(stop).empty()) {
+      const Coordinates coord = snapshot.StopCoordinates(stop);
       svg::Text text_underlay;
       svg::Text text;
       SetDefaultSettingsStopName(text_underlay, text);
-      SetName(text_underlay, name);
-      SetName(text, name);
-      SetPositionStop(text_underlay, stop_ptr->coord, sphere_projector);
-      SetPositionStop(text, stop_ptr->coord, sphere_projector);
+      SetName(text_underlay, snapshot.StopName(stop));
+      SetName(text, snapshot.StopName(stop));
+      SetPositionStop(text_underlay, coord, sphere_projector);
+      SetPositionStop(text, coord, sphere_projector);
       doc.Add(text_underlay);
       doc.Add(text);
     }
@@ -0,0 +1,46 @@
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <stdexcept>
+
+using namespace std;
+
+MappedFile::MappedFile(const string& path) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd == -1) {
+    throw runtime_error("can't open "s + path);
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) == -1) {
+    close(fd);
+    throw runtime_error("can't stat "s + path);
+  }
+  size_ = static_cast<size_t>(info.st_size);
+
+  // Пустой файл отобразить нельзя, для него достаточно пустого буфера
+  if (size_ != 0) {
+    void* addr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+      close(fd);
+      throw runtime_error("can't map "s + path);
+    }
+    madvise(addr, size_, MADV_SEQUENTIAL);
+    data_ = static_cast<const char*>(addr);
+  }
+  close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (data_ != nullptr) {
+    munmap(const_cast<char*>(data_), size_);
+  }
+}
+
+string_view MappedFile::GetData() const {
+  return {data_, size_};
+}
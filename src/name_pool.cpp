@@ -0,0 +1,36 @@
+#include "name_pool.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+namespace transport {
+
+string_view NamePool::Add(string_view name) {
+  if (name.empty()) {
+    return {};
+  }
+  size_ += name.size();
+  // Длинное имя получает свой блок, а начатый блок продолжает заполняться
+  if (name.size() > MAX_BLOCK_SIZE / 4) {
+    auto block = make_unique<char[]>(name.size());
+    memcpy(block.get(), name.data(), name.size());
+    const string_view result(block.get(), name.size());
+    blocks_.insert(blocks_.end() - (blocks_.empty() ? 0 : 1), move(block));
+    return result;
+  }
+  if (free_size_ < name.size()) {
+    free_size_ = max(next_block_size_, name.size());
+    blocks_.push_back(make_unique<char[]>(free_size_));
+    free_ = blocks_.back().get();
+    next_block_size_ = min(next_block_size_ * 2, MAX_BLOCK_SIZE);
+  }
+  memcpy(free_, name.data(), name.size());
+  const string_view result(free_, name.size());
+  free_ += name.size();
+  free_size_ -= name.size();
+  return result;
+}
+
+}  // namespace transport
@@ -1,53 +1,53 @@
 #include "request_handler.h"
 
+#include <cassert>
+
 RequestHandler::RequestHandler(transport::Catalogue& tc,
                                renderer::MapRenderer& renderer)
     : tc_(tc), renderer_(renderer) {}
 
-void RequestHandler::AddRoute(const std::string& number,
+void RequestHandler::AddRoute(std::string_view number,
                               std::vector<std::string>&& stops,
                               bool is_round) {
-  renderer::Route route;
-  if (!stops.empty()) {
-    route.first_stop = stops.front();
-    route.last_stop = stops.back();
-    if (!is_round) {
-      int stops_size = int(stops.size());
-      for (int i = stops_size - 2; i >= 0; --i) {
-        stops.push_back(stops[i]);
-      }
-    }
-  }
-  tc_.AddRoute(number, move(stops));
-  route.is_round = is_round;
-  route.bus = tc_.GetBusData(number);
-  renderer_.SetRoute(number, std::move(route));
-}
-
-void RequestHandler::AddStop(const std::string& name, Coordinates coord) {
+  tc_.AddRoute(number, move(stops), is_round);
+}
+
+void RequestHandler::AddStop(std::string_view name, Coordinates coord) {
   tc_.AddStop(name, coord);
-  Stop* stop_ptr = tc_.GetStopData(name);
-  renderer_.SetCoordinates(name, stop_ptr);
 }
 
-void RequestHandler::SetDistance(
-    const std::pair<std::string, std::string>& stops,
-    uint32_t distance) {
-  tc_.SetDistance(stops, distance);
+void RequestHandler::SetDistance(std::string_view from,
+                                 std::string_view to,
+                                 uint32_t distance) {
+  tc_.SetDistance(from, to, distance);
 }
 
 void RequestHandler::SetRendererSettings(renderer::RenderSettings& settings) {
   renderer_.SetRendererSettings(settings);
 }
 
-Bus* RequestHandler::GetBusData(const std::string& number) {
+Bus* RequestHandler::GetBusData(std::string_view number) {
   return tc_.GetBusData(number);
 }
 
-Stop* RequestHandler::GetStopData(const std::string& name) {
+Stop* RequestHandler::GetStopData(std::string_view name) {
   return tc_.GetStopData(name);
 }
 
+void RequestHandler::Freeze() {
+  versions_.Publish(tc_.Freeze());
+}
+
+void RequestHandler::SetSnapshot(
+    std::shared_ptr<const transport::Snapshot> snapshot) {
+  versions_.Publish(move(snapshot));
+}
+
+const transport::Snapshot& RequestHandler::GetSnapshot() const {
+  assert(versions_.Current() != nullptr);
+  return *versions_.Current();
+}
+
 svg::Document RequestHandler::RenderMap() const {
-  return renderer_.RenderMap();
+  return renderer_.RenderMap(GetSnapshot());
 }
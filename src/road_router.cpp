@@ -0,0 +1,544 @@
+#include "road_router.h"
+
+#include <algorithm>
+#include <climits>
+#include <functional>
+
+using namespace std;
+
+namespace transport {
+
+namespace {
+
+// Поиск свидетеля останавливается после стольких остановок. Если путь
+// в обход не нашёлся, добавляется лишняя срезка: это замедляет запросы,
+// но не портит ответы. Для оценки важности хватает короткого поиска
+constexpr size_t ESTIMATE_SETTLE_LIMIT = 32;
+constexpr size_t CONTRACT_SETTLE_LIMIT = 100;
+// Сжатие останавливается, когда у оставшихся остановок в среднем
+// больше стольких исходящих рёбер, и они образуют ядро. В дорожных сетях
+// до этого доходит небольшая верхушка иерархии, а в случайных графах
+// срезки множатся лавинообразно с самого начала
+constexpr size_t CORE_AVERAGE_DEGREE = 24;
+// Остановка, у которой произведение чисел входящих и исходящих рёбер
+// больше этого, тоже остаётся в ядре
+constexpr uint64_t CORE_DEGREE_PRODUCT = 1024;
+constexpr int CORE_PRIORITY = INT_MAX;
+
+struct Arc {
+  StopId stop;
+  StopId via;
+  uint64_t distance;
+};
+
+struct Shortcut {
+  StopId from;
+  StopId to;
+  uint64_t distance;
+};
+
+using QueueItem = pair<uint64_t, uint32_t>;
+
+// Куча с ближайшей остановкой сверху
+void Push(vector<QueueItem>& queue, uint64_t distance, uint32_t stop) {
+  queue.push_back({distance, stop});
+  push_heap(queue.begin(), queue.end(), greater<QueueItem>());
+}
+
+QueueItem Pop(vector<QueueItem>& queue) {
+  pop_heap(queue.begin(), queue.end(), greater<QueueItem>());
+  const QueueItem item = queue.back();
+  queue.pop_back();
+  return item;
+}
+
+const HierarchyEdge* FindEdge(Span<HierarchyEdge> edges, uint32_t to) {
+  const HierarchyEdge* edge =
+      find_if(edges.begin(), edges.end(),
+              [to](const HierarchyEdge& edge) { return edge.to == to; });
+  return edge != edges.end() ? edge : nullptr;
+}
+
+// Граф, из которого по одной удаляются сжатые остановки. В списках
+// соседей остаются только ещё не сжатые
+class Contractor {
+ public:
+  explicit Contractor(const Snapshot& snapshot)
+      : stop_count_(snapshot.StopCount()),
+        out_(stop_count_),
+        in_(stop_count_),
+        contracted_neighbors_(stop_count_, 0),
+        core_(stop_count_, 1),
+        priorities_(stop_count_, 0),
+        levels_(stop_count_, 0),
+        slots_(stop_count_, 0),
+        distances_(stop_count_, 0),
+        marks_(stop_count_, 0),
+        targets_(stop_count_, 0) {
+    for (StopId from = 0; from < stop_count_; ++from) {
+      for (const RoadTarget& target : snapshot.Roads(from)) {
+        if (target.to != from) {
+          out_[from].push_back(
+              {target.to, HierarchyEdge::NO_VIA, target.distance});
+          in_[target.to].push_back(
+              {from, HierarchyEdge::NO_VIA, target.distance});
+          ++arc_count_;
+        }
+      }
+    }
+  }
+
+  Snapshot::Hierarchy Run() {
+    vector<vector<HierarchyEdge>> up(stop_count_);
+    vector<vector<HierarchyEdge>> down(stop_count_);
+
+    // После каждого сжатия важность соседей только поправляется на число
+    // сжатых соседей и глубину, а поиском пересчитывается перед сжатием
+    // самой остановки: если она стала важнее следующей в очереди,
+    // то возвращается в очередь. Устаревшие записи пропускаются.
+    // Срезки для самого сжатия ищутся заново более длинным поиском
+    vector<pair<int, StopId>> queue;
+    size_t remaining = stop_count_;
+    if (!IsDense(remaining)) {
+      queue.reserve(stop_count_);
+      for (StopId stop = 0; stop < stop_count_; ++stop) {
+        priorities_[stop] = Priority(stop);
+        queue.push_back({priorities_[stop], stop});
+      }
+    }
+    make_heap(queue.begin(), queue.end(), greater<pair<int, StopId>>());
+    vector<StopId> neighbors;
+    vector<StopId> order;
+    order.reserve(stop_count_);
+    while (!queue.empty()) {
+      pop_heap(queue.begin(), queue.end(), greater<pair<int, StopId>>());
+      const auto [queued, stop] = queue.back();
+      queue.pop_back();
+      if (!core_[stop] || queued != priorities_[stop]) {
+        continue;
+      }
+      const int priority = Priority(stop);
+      if (!queue.empty() && priority > queue.front().first) {
+        priorities_[stop] = priority;
+        queue.push_back({priority, stop});
+        push_heap(queue.begin(), queue.end(), greater<pair<int, StopId>>());
+        continue;
+      }
+      if (priority == CORE_PRIORITY || IsDense(remaining)) {
+        break;
+      }
+
+      neighbors.clear();
+      for (const vector<Arc>* arcs : {&out_[stop], &in_[stop]}) {
+        for (const Arc& arc : *arcs) {
+          neighbors.push_back(arc.stop);
+        }
+      }
+      FindShortcuts(stop, CONTRACT_SETTLE_LIMIT);
+      Contract(stop, up[stop], down[stop]);
+      core_[stop] = 0;
+      order.push_back(stop);
+      --remaining;
+
+      sort(neighbors.begin(), neighbors.end());
+      neighbors.erase(unique(neighbors.begin(), neighbors.end()),
+                      neighbors.end());
+      for (StopId neighbor : neighbors) {
+        const int level = max(levels_[neighbor], levels_[stop] + 1);
+        if (priorities_[neighbor] != CORE_PRIORITY) {
+          priorities_[neighbor] += 1 + level - levels_[neighbor];
+        }
+        levels_[neighbor] = level;
+        queue.push_back({priorities_[neighbor], neighbor});
+        push_heap(queue.begin(), queue.end(), greater<pair<int, StopId>>());
+      }
+    }
+
+    // Рёбра ядра ведут только в ядро и попадают в иерархию целиком
+    Snapshot::Hierarchy hierarchy;
+    hierarchy.core_rank = order.size();
+    for (StopId stop = 0; stop < stop_count_; ++stop) {
+      if (core_[stop]) {
+        order.push_back(stop);
+        for (const Arc& out : out_[stop]) {
+          up[stop].push_back({out.stop, out.via, out.distance});
+        }
+        for (const Arc& in : in_[stop]) {
+          down[stop].push_back({in.stop, in.via, in.distance});
+        }
+      }
+    }
+
+    hierarchy.ranks.resize(stop_count_);
+    for (uint32_t rank = 0; rank < stop_count_; ++rank) {
+      hierarchy.ranks[order[rank]] = rank;
+    }
+    hierarchy.stops = move(order);
+    Flatten(up, hierarchy, hierarchy.up_offsets, hierarchy.up_edges);
+    Flatten(down, hierarchy, hierarchy.down_offsets, hierarchy.down_edges);
+    return hierarchy;
+  }
+
+ private:
+  size_t stop_count_;
+  vector<vector<Arc>> out_;
+  vector<vector<Arc>> in_;
+  vector<uint32_t> contracted_neighbors_;
+  vector<uint8_t> core_;
+  vector<int> priorities_;
+  // Глубина в иерархии: на единицу больше, чем у сжатых соседей
+  vector<int> levels_;
+  size_t arc_count_ = 0;
+  // Срезки, которые нужны при сжатии последней оценённой остановки
+  vector<Shortcut> shortcuts_;
+  // Положение ребра в out_ начала срезки, если оно там есть
+  vector<uint32_t> slots_;
+
+  // Состояние поиска свидетелей
+  vector<uint64_t> distances_;
+  vector<uint32_t> marks_;
+  // Концы срезок, которые проверяет текущий поиск
+  vector<uint32_t> targets_;
+  uint32_t epoch_ = 0;
+  vector<QueueItem> queue_;
+
+  // Рёбер между оставшимися остановками хранится по одному разу в out_
+  bool IsDense(size_t remaining) const {
+    return arc_count_ > remaining * CORE_AVERAGE_DEGREE;
+  }
+
+  int Priority(StopId stop) {
+    if (uint64_t(in_[stop].size()) * out_[stop].size() > CORE_DEGREE_PRODUCT) {
+      return CORE_PRIORITY;
+    }
+    FindShortcuts(stop, ESTIMATE_SETTLE_LIMIT);
+    return int(shortcuts_.size()) -
+           int(in_[stop].size() + out_[stop].size()) +
+           int(contracted_neighbors_[stop]) + levels_[stop];
+  }
+
+  // Срезка u -> w нужна, если без stop от u до w не дойти
+  // за длину пути u -> stop -> w
+  void FindShortcuts(StopId stop, size_t settle_limit) {
+    shortcuts_.clear();
+    for (const Arc& in : in_[stop]) {
+      NextEpoch();
+      uint64_t limit = 0;
+      size_t targets = 0;
+      for (const Arc& out : out_[stop]) {
+        if (out.stop != in.stop) {
+          limit = max<uint64_t>(limit, in.distance + out.distance);
+          targets_[out.stop] = epoch_;
+          ++targets;
+        }
+      }
+      if (targets == 0) {
+        continue;
+      }
+      SearchWitnesses(in.stop, stop, limit, targets, settle_limit);
+      for (const Arc& out : out_[stop]) {
+        const uint64_t distance = in.distance + out.distance;
+        if (out.stop != in.stop &&
+            (marks_[out.stop] != epoch_ || distances_[out.stop] > distance)) {
+          shortcuts_.push_back({in.stop, out.stop, distance});
+        }
+      }
+    }
+  }
+
+  void NextEpoch() {
+    if (++epoch_ == 0) {
+      fill(marks_.begin(), marks_.end(), 0);
+      fill(targets_.begin(), targets_.end(), 0);
+      epoch_ = 1;
+    }
+  }
+
+  // Дейкстра от source в обход skipped не дальше limit. Кончается,
+  // когда до всех targets_ известны кратчайшие расстояния
+  void SearchWitnesses(StopId source, StopId skipped, uint64_t limit,
+                       size_t targets, size_t settle_limit) {
+    queue_.clear();
+    marks_[source] = epoch_;
+    distances_[source] = 0;
+    Push(queue_, 0, source);
+    size_t settled = 0;
+    while (!queue_.empty()) {
+      const auto [distance, stop] = Pop(queue_);
+      if (distance > distances_[stop]) {
+        continue;
+      }
+      if (distance > limit || ++settled > settle_limit) {
+        break;
+      }
+      if (targets_[stop] == epoch_ && --targets == 0) {
+        break;
+      }
+      for (const Arc& arc : out_[stop]) {
+        const uint64_t next = distance + arc.distance;
+        if (arc.stop != skipped &&
+            (marks_[arc.stop] != epoch_ || next < distances_[arc.stop])) {
+          marks_[arc.stop] = epoch_;
+          distances_[arc.stop] = next;
+          Push(queue_, next, arc.stop);
+        }
+      }
+    }
+  }
+
+  // Оставшиеся рёбра остановки ведут в более важные и попадают
+  // в иерархию. shortcuts_ должны быть найдены для этой остановки
+  void Contract(StopId stop, vector<HierarchyEdge>& up,
+                vector<HierarchyEdge>& down) {
+    auto erase_stop = [stop](vector<Arc>& arcs) {
+      arcs.erase(remove_if(arcs.begin(), arcs.end(),
+                           [stop](const Arc& arc) { return arc.stop == stop; }),
+                 arcs.end());
+    };
+    arc_count_ -= out_[stop].size() + in_[stop].size();
+    for (const Arc& out : out_[stop]) {
+      up.push_back({out.stop, out.via, out.distance});
+      erase_stop(in_[out.stop]);
+      ++contracted_neighbors_[out.stop];
+    }
+    for (const Arc& in : in_[stop]) {
+      down.push_back({in.stop, in.via, in.distance});
+      erase_stop(out_[in.stop]);
+      ++contracted_neighbors_[in.stop];
+    }
+    AddShortcuts(stop);
+    out_[stop] = {};
+    in_[stop] = {};
+  }
+
+  // Из параллельных рёбер остаётся кратчайшее. Срезки сгруппированы
+  // по началу, и на каждую группу положения рёбер начала в out_
+  // запоминаются один раз, а не ищутся для каждой срезки
+  void AddShortcuts(StopId via) {
+    for (size_t i = 0; i < shortcuts_.size(); ++i) {
+      const auto [from, to, distance] = shortcuts_[i];
+      vector<Arc>& out = out_[from];
+      if (i == 0 || shortcuts_[i - 1].from != from) {
+        for (uint32_t slot = 0; slot < out.size(); ++slot) {
+          slots_[out[slot].stop] = slot;
+        }
+      }
+      const uint32_t slot = slots_[to];
+      if (slot >= out.size() || out[slot].stop != to) {
+        out.push_back({to, via, distance});
+        in_[to].push_back({from, via, distance});
+        ++arc_count_;
+      } else if (distance < out[slot].distance) {
+        out[slot] = {to, via, distance};
+        for (Arc& arc : in_[to]) {
+          if (arc.stop == from) {
+            arc = {from, via, distance};
+          }
+        }
+      }
+    }
+  }
+
+  // Списки переставляются по номерам остановок в иерархии,
+  // и концы рёбер заменяются номерами
+  static void Flatten(vector<vector<HierarchyEdge>>& lists,
+                      const Snapshot::Hierarchy& hierarchy,
+                      vector<uint32_t>& offsets, vector<HierarchyEdge>& edges) {
+    offsets.reserve(lists.size() + 1);
+    offsets.push_back(0);
+    for (StopId stop : hierarchy.stops) {
+      vector<HierarchyEdge>& list = lists[stop];
+      for (HierarchyEdge& edge : list) {
+        edge.to = hierarchy.ranks[edge.to];
+        if (edge.via != HierarchyEdge::NO_VIA) {
+          edge.via = hierarchy.ranks[edge.via];
+        }
+      }
+      sort(list.begin(), list.end(),
+           [](const HierarchyEdge& lhs, const HierarchyEdge& rhs) {
+             return lhs.distance < rhs.distance;
+           });
+      edges.insert(edges.end(), list.begin(), list.end());
+      offsets.push_back(edges.size());
+    }
+  }
+};
+
+}  // namespace
+
+Snapshot::Hierarchy ContractRoads(const Snapshot& snapshot) {
+  return Contractor(snapshot).Run();
+}
+
+RoadRouter::RoadRouter(const Snapshot& snapshot)
+    : snapshot_(snapshot), hierarchy_(snapshot.GetRoadHierarchy()) {
+  if (hierarchy_.empty()) {
+    built_ = ContractRoads(snapshot);
+    hierarchy_ = built_.View();
+  }
+}
+
+optional<RoadRouter::Route> RoadRouter::FindRoute(StopId from, StopId to) {
+  const size_t stop_count = snapshot_.StopCount();
+  if (labels_.size() != stop_count) {
+    labels_.assign(stop_count, {});
+  }
+  if (++epoch_ == 0) {
+    for (array<Label, 2>& labels : labels_) {
+      labels[FORWARD].mark = labels[BACKWARD].mark = 0;
+    }
+    epoch_ = 1;
+  }
+  for (size_t side : {FORWARD, BACKWARD}) {
+    queues_[side].clear();
+    entries_[side].clear();
+  }
+  const uint32_t source = hierarchy_.Rank(from);
+  const uint32_t target = hierarchy_.Rank(to);
+  best_ = INFINITE;
+  meeting_ = source;
+  Reach(FORWARD, source, 0, source);
+  Reach(BACKWARD, target, 0, target);
+
+  Climb();
+  SearchCore();
+  if (best_ == INFINITE) {
+    return nullopt;
+  }
+
+  // Ребро к остановке ищется в списке той, откуда она достигнута
+  Route route;
+  route.distance = best_;
+  route.stops.push_back(from);
+  vector<uint32_t> chain;
+  for (uint32_t stop = meeting_; stop != source;
+       stop = labels_[stop][FORWARD].parent) {
+    chain.push_back(stop);
+  }
+  for (auto iter = chain.rbegin(); iter != chain.rend(); ++iter) {
+    const uint32_t parent = labels_[*iter][FORWARD].parent;
+    const HierarchyEdge* edge =
+        FindEdge(hierarchy_.UpwardEdges(parent), *iter);
+    Unpack(parent, *iter, edge->via, route.stops);
+  }
+  for (uint32_t stop = meeting_; stop != target;
+       stop = labels_[stop][BACKWARD].parent) {
+    const uint32_t parent = labels_[stop][BACKWARD].parent;
+    const HierarchyEdge* edge =
+        FindEdge(hierarchy_.DownwardEdges(parent), stop);
+    Unpack(stop, parent, edge->via, route.stops);
+  }
+  return route;
+}
+
+// Подъёмы с обоих концов чередуются, чтобы путь нашёлся пораньше
+// и отсекал лишнее. Каждый идёт, пока ближайшая в очереди остановка
+// ближе лучшего пути: вершина пути вверх-вниз может быть далеко
+// от середины
+void RoadRouter::Climb() {
+  while (min(Front(FORWARD), Front(BACKWARD)) < best_) {
+    const size_t side = Front(FORWARD) <= Front(BACKWARD) ? FORWARD : BACKWARD;
+    const auto [distance, stop] = Pop(queues_[side]);
+    if (distance > labels_[stop][side].distance) {
+      continue;
+    }
+    if (hierarchy_.InCore(stop)) {
+      entries_[side].push_back(stop);
+      continue;
+    }
+    if (!IsStalled(side, stop, distance)) {
+      Relax(side, stop, distance, false);
+    }
+  }
+  queues_[FORWARD].clear();
+  queues_[BACKWARD].clear();
+}
+
+// Если до остановки короче дойти сверху, через неё не проходит
+// кратчайший путь вверх-вниз, и её рёбра можно не просматривать
+bool RoadRouter::IsStalled(size_t side, uint32_t stop,
+                           uint64_t distance) const {
+  for (const HierarchyEdge& edge : Edges(1 - side, stop)) {
+    if (edge.distance >= distance) {
+      break;
+    }
+    if (Reached(side, edge.to) &&
+        labels_[edge.to][side].distance + edge.distance < distance) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// В ядре иерархии нет, поэтому поиск обычный двунаправленный
+// и останавливается, когда сумма расстояний в очередях не меньше пути
+void RoadRouter::SearchCore() {
+  for (size_t side : {FORWARD, BACKWARD}) {
+    for (uint32_t stop : entries_[side]) {
+      Push(queues_[side], labels_[stop][side].distance, stop);
+    }
+  }
+  while (!queues_[FORWARD].empty() && !queues_[BACKWARD].empty() &&
+         Front(FORWARD) + Front(BACKWARD) < best_) {
+    const size_t side = Front(FORWARD) <= Front(BACKWARD) ? FORWARD : BACKWARD;
+    const auto [distance, stop] = Pop(queues_[side]);
+    if (distance > labels_[stop][side].distance) {
+      continue;
+    }
+    Relax(side, stop, distance, true);
+  }
+}
+
+// Рёбра упорядочены по длине, поэтому просмотр кончается на первом,
+// которое ведёт дальше лучшего пути. В ядре другая сторона ещё
+// не дошла до непомеченных остановок ближе своей очереди, и остановка,
+// путь через которую заведомо не короче лучшего, в очередь не попадает
+void RoadRouter::Relax(size_t side, uint32_t from, uint64_t distance,
+                       bool in_core) {
+  const size_t other = 1 - side;
+  const uint64_t other_front = in_core ? Front(other) : 0;
+  for (const HierarchyEdge& edge : Edges(side, from)) {
+    const uint64_t next = distance + edge.distance;
+    if (next >= best_) {
+      break;
+    }
+    const array<Label, 2>& labels = labels_[edge.to];
+    if (labels[side].mark == epoch_ && next >= labels[side].distance) {
+      continue;
+    }
+    if (labels[other].mark != epoch_ && other_front >= best_ - next) {
+      continue;
+    }
+    Reach(side, edge.to, next, from);
+  }
+}
+
+// Путь через остановку проверяется, когда она получает метку с одной
+// стороны, а с другой уже помечена
+void RoadRouter::Reach(size_t side, uint32_t stop, uint64_t distance,
+                       uint32_t parent) {
+  array<Label, 2>& labels = labels_[stop];
+  labels[side] = {distance, epoch_, parent};
+  Push(queues_[side], distance, stop);
+  const Label& other = labels[1 - side];
+  if (other.mark == epoch_ && distance + other.distance < best_) {
+    best_ = distance + other.distance;
+    meeting_ = stop;
+  }
+}
+
+// Срезка from -> to через via раскрывается в рёбра from -> via
+// и via -> to, которые лежат в списках via
+void RoadRouter::Unpack(uint32_t from, uint32_t to, uint32_t via,
+                        vector<StopId>& stops) const {
+  if (via == HierarchyEdge::NO_VIA) {
+    stops.push_back(hierarchy_.Stop(to));
+    return;
+  }
+  const HierarchyEdge* first = FindEdge(hierarchy_.DownwardEdges(via), from);
+  const HierarchyEdge* second = FindEdge(hierarchy_.UpwardEdges(via), to);
+  Unpack(from, via, first->via, stops);
+  Unpack(via, to, second->via, stops);
+}
+
+}  // namespace transport
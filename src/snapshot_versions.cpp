@@ -0,0 +1,92 @@
+#include "snapshot_versions.h"
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+using namespace std;
+
+namespace transport {
+
+SnapshotVersions::Pin::Pin(Pin&& other) noexcept
+    : epoch_(other.epoch_), snapshot_(other.snapshot_) {
+  other.epoch_ = nullptr;
+  other.snapshot_ = nullptr;
+}
+
+SnapshotVersions::Pin::~Pin() {
+  if (epoch_ != nullptr) {
+    epoch_->store(IDLE, memory_order_release);
+  }
+}
+
+SnapshotVersions::SnapshotVersions(size_t max_readers)
+    : readers_(make_unique<ReaderSlot[]>(max_readers)),
+      max_readers_(max_readers) {}
+
+// Слот занимается сравнением с обменом, поэтому читатели могут
+// регистрироваться одновременно. Освобождённые слоты выдаются заново
+size_t SnapshotVersions::RegisterReader() {
+  for (size_t reader = 0; reader < max_readers_; ++reader) {
+    bool used = false;
+    if (readers_[reader].used.compare_exchange_strong(used, true)) {
+      size_t count = reader_count_.load();
+      while (count <= reader &&
+             !reader_count_.compare_exchange_weak(count, reader + 1)) {
+      }
+      return reader;
+    }
+  }
+  throw length_error("too many snapshot readers"s);
+}
+
+void SnapshotVersions::UnregisterReader(size_t reader) {
+  assert(reader < reader_count_.load(memory_order_relaxed));
+  assert(readers_[reader].epoch.load(memory_order_relaxed) == IDLE);
+  readers_[reader].used.store(false);
+}
+
+// Читатель сначала объявляет эпоху, потом берёт указатель. Все операции
+// здесь и в Publish последовательно согласованы: если писатель не увидел
+// объявления, то читатель увидит уже новую версию
+SnapshotVersions::Pin SnapshotVersions::Acquire(size_t reader) const {
+  assert(reader < reader_count_.load(memory_order_relaxed));
+  atomic<uint64_t>& epoch = readers_[reader].epoch;
+  assert(epoch.load(memory_order_relaxed) == IDLE);
+  epoch.store(epoch_.load());
+  const Snapshot* snapshot = current_.load();
+  assert(snapshot != nullptr);
+  return Pin(&epoch, snapshot);
+}
+
+void SnapshotVersions::Publish(shared_ptr<const Snapshot> snapshot) {
+  lock_guard lock(writer_mutex_);
+  current_.store(snapshot.get());
+  const uint64_t epoch = epoch_.fetch_add(1) + 1;
+  if (owner_ != nullptr) {
+    retired_.push_back({move(owner_), epoch});
+  }
+  owner_ = move(snapshot);
+  ReclaimLocked();
+}
+
+size_t SnapshotVersions::Reclaim() {
+  lock_guard lock(writer_mutex_);
+  return ReclaimLocked();
+}
+
+size_t SnapshotVersions::ReclaimLocked() {
+  uint64_t oldest = IDLE;
+  const size_t reader_count = reader_count_.load();
+  for (size_t reader = 0; reader < reader_count; ++reader) {
+    oldest = min(oldest, readers_[reader].epoch.load());
+  }
+  retired_.erase(remove_if(retired_.begin(), retired_.end(),
+                           [oldest](const Retired& retired) {
+                             return retired.epoch <= oldest;
+                           }),
+                 retired_.end());
+  return retired_.size();
+}
+
+}  // namespace transport
@@ -1,5 +1,8 @@
-#include <unordered_set>
+#include <algorithm>
 #include <cassert>
+#include <iterator>
+#include <numeric>
+#include <stdexcept>
 
 #include "geo.h"
 #include "transport_catalogue.h"
@@ -8,108 +11,469 @@ using namespace std;
 
 namespace transport {
 
-void Catalogue::AddRoute(const string& number, vector<string>&& stops) {
-  AddRouteToStops(number, stops);
-  Bus bus;
-  SetLengthAndCurvature(bus, stops);
-  SetNumberStopsAndUniqueStops(bus, stops);
-  bus.stops = move(stops);
-  buses_.push_back(bus);
-  busesPtr_.insert({number, &buses_.back()});
-}
-
-void Catalogue::SetLengthAndCurvature(Bus& bus,
-                                      const vector<string>& stops) {
-  double geographicLength = 0;
-  for (size_t i = 0; i < stops.size() - 1 && stops.size() != 0; ++i) {
-    pair<string, string> stops_pair{stops[i], stops[i + 1]};
-    bus.routeLength += GetDistance(stops_pair);
-    geographicLength += ComputeDistance(stopsPtr_[stops[i]]->coord,
-                                        stopsPtr_[stops[i + 1]]->coord);
+void Catalogue::AddRoute(string_view number, vector<string>&& stops,
+                         bool is_roundtrip) {
+  Bus& bus = buses_.emplace_back();
+  bus.id = BusId(buses_.size() - 1);
+  bus.name = names_.Add(number);
+  bus.isRoundtrip = is_roundtrip;
+  busIds_.insert({bus.name, bus.id});
+  pendingRoutes_.push_back({bus.id, move(stops)});
+}
+
+void Catalogue::Finalize(unsigned thread_count) {
+  for (const PendingRoad& road : pendingRoads_) {
+    const Stop* from = FindStop(road.from);
+    const Stop* to = FindStop(road.to);
+    if (from != nullptr && to != nullptr) {
+      SetDistance(from->id, to->id, road.distance);
+    }
+  }
+  pendingRoads_.clear();
+
+  vector<BusId> resolved;
+  resolved.reserve(pendingRoutes_.size());
+  for (PendingRoute& route : pendingRoutes_) {
+    Bus& bus = buses_[route.bus];
+    bus.stops.clear();
+    bus.stops.reserve(route.stops.size());
+    for (const string& stop : route.stops) {
+      const auto iter = stopIds_.find(stop);
+      if (iter == stopIds_.end()) {
+        throw invalid_argument("Stop '"s + stop + "' of bus '"s +
+                               string(bus.name) + "' has not been added"s);
+      }
+      bus.stops.push_back(iter->second);
+    }
+    resolved.push_back(route.bus);
+  }
+  pendingRoutes_.clear();
+  AddRoutesToStops(resolved);
+
+  changedBuses_.insert(changedBuses_.end(), resolved.begin(), resolved.end());
+  sort(changedBuses_.begin(), changedBuses_.end());
+  changedBuses_.erase(unique(changedBuses_.begin(), changedBuses_.end()),
+                      changedBuses_.end());
+  changedBuses_.erase(remove_if(changedBuses_.begin(), changedBuses_.end(),
+                                [this](BusId id) { return buses_[id].removed; }),
+                      changedBuses_.end());
+  ComputeBusStats(changedBuses_, thread_count);
+  changedBuses_.clear();
+}
+
+Stop& Catalogue::GetLiveStop(string_view name) {
+  Stop* stop = FindStop(name);
+  if (stop == nullptr) {
+    throw invalid_argument("Unknown stop '"s + string(name) + "'"s);
+  }
+  return *stop;
+}
+
+Bus& Catalogue::GetLiveBus(string_view number) {
+  Bus* bus = FindRoute(number);
+  if (bus == nullptr) {
+    throw invalid_argument("Unknown bus '"s + string(number) + "'"s);
+  }
+  return *bus;
+}
+
+// Любое изменение остановки затрагивает только маршруты через неё
+void Catalogue::MarkStopBuses(StopId stop) {
+  const vector<BusId>& buses = stops_[stop].buses;
+  changedBuses_.insert(changedBuses_.end(), buses.begin(), buses.end());
+}
+
+void Catalogue::UpdateStop(string_view name, Coordinates coord) {
+  Stop& stop = GetLiveStop(name);
+  stop.coord = coord;
+  geoPoints_[stop.id] = GeoPoint(coord);
+  MarkStopBuses(stop.id);
+}
+
+// Из пути вырезается остановка, и соседние одинаковые остановки
+// склеиваются. Кольцевой маршрут замыкается на новую первую остановку.
+// Маршрут, в котором не осталось хотя бы двух разных остановок, удаляется
+void Catalogue::RemoveStop(string_view name) {
+  Stop& stop = GetLiveStop(name);
+  MarkStopBuses(stop.id);
+  const vector<BusId> buses = move(stop.buses);
+  stop.buses.clear();
+  for (BusId id : buses) {
+    Bus& bus = buses_[id];
+    vector<StopId>& stops = bus.stops;
+    stops.erase(remove(stops.begin(), stops.end(), stop.id), stops.end());
+    stops.erase(unique(stops.begin(), stops.end()), stops.end());
+    if (bus.isRoundtrip && !stops.empty() && stops.front() != stops.back()) {
+      stops.push_back(stops.front());
+    }
+    if (stops.size() < (bus.isRoundtrip ? 3u : 2u)) {
+      DropRoute(bus);
+    }
+  }
+
+  const size_t roads = roads_.size();
+  roads_.erase(remove_if(roads_.begin(), roads_.end(),
+                         [&stop](const Road& road) {
+                           return road.from == stop.id || road.to == stop.id;
+                         }),
+               roads_.end());
+  roadsChanged_ = roadsChanged_ || roads != roads_.size();
+
+  stop.removed = true;
+  stopIds_.erase(stop.name);
+}
+
+// Расстояние from -> to используется только на отрезках, один из концов
+// которых from: в прямую сторону и как запасное в обратную
+void Catalogue::UpdateDistance(string_view from, string_view to,
+                               uint32_t distance) {
+  const StopId from_id = GetLiveStop(from).id;
+  SetDistance(from_id, GetLiveStop(to).id, distance);
+  MarkStopBuses(from_id);
+}
+
+void Catalogue::UpdateRoute(string_view number, vector<string>&& stops,
+                            bool is_roundtrip) {
+  Bus& bus = GetLiveBus(number);
+  RemoveRouteFromStops(bus);
+  bus.stops.clear();
+  bus.isRoundtrip = is_roundtrip;
+  // Ещё не разрешённый прежний путь больше не нужен
+  pendingRoutes_.erase(remove_if(pendingRoutes_.begin(), pendingRoutes_.end(),
+                                 [&bus](const PendingRoute& route) {
+                                   return route.bus == bus.id;
+                                 }),
+                       pendingRoutes_.end());
+  pendingRoutes_.push_back({bus.id, move(stops)});
+}
+
+void Catalogue::RemoveRoute(string_view number) {
+  DropRoute(GetLiveBus(number));
+}
+
+void Catalogue::DropRoute(Bus& bus) {
+  RemoveRouteFromStops(bus);
+  pendingRoutes_.erase(remove_if(pendingRoutes_.begin(), pendingRoutes_.end(),
+                                 [&bus](const PendingRoute& route) {
+                                   return route.bus == bus.id;
+                                 }),
+                       pendingRoutes_.end());
+  bus.removed = true;
+  busIds_.erase(bus.name);
+}
+
+void Catalogue::RemoveRouteFromStops(const Bus& bus) {
+  for (StopId stop : bus.stops) {
+    vector<BusId>& buses = stops_[stop].buses;
+    buses.erase(remove(buses.begin(), buses.end(), bus.id), buses.end());
+  }
+}
+
+// Маршруты делятся на непрерывные части по числу потоков. Каждый маршрут
+// считается целиком одним потоком и тем же кодом, что и без потоков,
+// поэтому результат от их числа не зависит
+void Catalogue::ComputeBusStats(const vector<BusId>& buses,
+                                unsigned thread_count) {
+  // Таблица расстояний должна быть готова до запуска потоков:
+  // дальше они её только читают
+  if (roadsChanged_) {
+    BuildRoads();
   }
+  const auto compute = [this, &buses](size_t begin, size_t end) {
+    StopMarks marks{vector<uint32_t>(stops_.size(), 0)};
+    vector<StopId> path;
+    for (size_t i = begin; i < end; ++i) {
+      SetLengthAndCurvature(buses_[buses[i]], path);
+      SetNumberStopsAndUniqueStops(buses_[buses[i]], marks);
+    }
+  };
+
+  const size_t count = buses.size();
+  thread_count = min<size_t>(thread_count, count / MIN_BUSES_PER_THREAD);
+  if (thread_count <= 1) {
+    compute(0, count);
+    return;
+  }
+  vector<thread> threads;
+  threads.reserve(thread_count - 1);
+  const size_t chunk = (count + thread_count - 1) / thread_count;
+  for (size_t begin = chunk; begin < count; begin += chunk) {
+    threads.emplace_back(compute, begin, min(begin + chunk, count));
+  }
+  compute(0, chunk);
+  for (thread& worker : threads) {
+    worker.join();
+  }
+}
+
+// Некольцевой маршрут разворачивается во временный буфер, чтобы
+// длина считалась по всему пути и в том же порядке сложений
+void Catalogue::SetLengthAndCurvature(Bus& bus, vector<StopId>& path) {
+  const RouteView route = bus.Route();
+  path.assign(route.begin(), route.end());
+  bus.routeLength = 0;
+  for (size_t i = 1; i < path.size(); ++i) {
+    bus.routeLength += GetDistance(path[i - 1], path[i]);
+  }
+  const double geographicLength =
+      ComputePathLength(geoPoints_.data(), path.data(), path.size());
   bus.curvature = double(bus.routeLength) / geographicLength;
 }
 
-void Catalogue::SetNumberStopsAndUniqueStops(Bus& bus, const vector<string>& stops) {
-  unordered_set<string> stopsSet;
-  for (const string& stop : stops) {
-    stopsSet.insert(stop);
+// Каждый маршрут получает новый номер прохода, поэтому отметки
+// не нужно стирать между маршрутами
+void Catalogue::SetNumberStopsAndUniqueStops(Bus& bus, StopMarks& marks) {
+  if (++marks.epoch == 0) {
+    fill(marks.marks.begin(), marks.marks.end(), 0);
+    marks.epoch = 1;
+  }
+  int uniqueStops = 0;
+  for (StopId stop : bus.stops) {
+    if (marks.marks[stop] != marks.epoch) {
+      marks.marks[stop] = marks.epoch;
+      ++uniqueStops;
+    }
   }
-  bus.uniqueStops = stopsSet.size();
-  bus.stopsOnRoute = stops.size();
+  bus.uniqueStops = uniqueStops;
+  bus.stopsOnRoute = bus.Route().size();
 }
 
-void Catalogue::AddRouteToStops(const string& number, const vector<string>& stops) {
-  for (auto& stop : stops) {
-    stopsPtr_[stop]->buses.insert(number);
-  } 
+// Маршруты дописываются к спискам своих остановок, затем каждый
+// затронутый список один раз упорядочивается по названию. Из маршрутов
+// с одинаковым названием остаётся добавленный первым
+void Catalogue::AddRoutesToStops(const vector<BusId>& buses) {
+  vector<StopId> touched;
+  for (BusId id : buses) {
+    for (StopId stop : buses_[id].stops) {
+      stops_[stop].buses.push_back(id);
+      touched.push_back(stop);
+    }
+  }
+  sort(touched.begin(), touched.end());
+  touched.erase(unique(touched.begin(), touched.end()), touched.end());
+
+  for (StopId stop : touched) {
+    vector<BusId>& buses = stops_[stop].buses;
+    stable_sort(buses.begin(), buses.end(), [this](BusId lhs, BusId rhs) {
+      return buses_[lhs].name < buses_[rhs].name;
+    });
+    buses.erase(unique(buses.begin(), buses.end(),
+                       [this](BusId lhs, BusId rhs) {
+                         return buses_[lhs].name == buses_[rhs].name;
+                       }),
+                buses.end());
+  }
 }
 
-void Catalogue::AddStop(const string& name, Coordinates coord) {
-  Stop stop;
+StopId Catalogue::AddStop(string_view name, Coordinates coord) {
+  if (auto iter = stopIds_.find(name); iter != stopIds_.end()) {
+    return iter->second;
+  }
+  Stop& stop = stops_.emplace_back();
+  stop.id = StopId(stops_.size() - 1);
+  stop.name = names_.Add(name);
   stop.coord.lat = coord.lat;
   stop.coord.lng = coord.lng;
-  stops_.push_back(stop);
-  stopsPtr_.insert({name, &stops_.back()});
+  geoPoints_.emplace_back(coord);
+  stopIds_.insert({stop.name, stop.id});
+  return stop.id;
 }
 
-Bus* Catalogue::FindRoute(const string& number) {
-  auto iter = busesPtr_.find(number);
-  if (iter == busesPtr_.end()) {
+Bus* Catalogue::FindRoute(string_view number) {
+  auto iter = busIds_.find(number);
+  if (iter == busIds_.end()) {
     return nullptr;
   } else {
-    return iter->second;
+    return &buses_[iter->second];
   }
 }
 
-Stop* Catalogue::FindStop(const string& stop) {
-  auto iter = stopsPtr_.find(stop);
-  if (iter == stopsPtr_.end()) {
+Stop* Catalogue::FindStop(string_view stop) {
+  auto iter = stopIds_.find(stop);
+  if (iter == stopIds_.end()) {
     return nullptr;
   } else {
-    return iter->second;
+    return &stops_[iter->second];
   }
 }
 
-Bus* Catalogue::GetBusData(const string& number) {
-  auto iter = busesPtr_.find(number);
-  if (iter == busesPtr_.end()) {
-    return nullptr;
+Bus* Catalogue::GetBusData(string_view number) {
+  return FindRoute(number);
+}
+
+Stop* Catalogue::GetStopData(string_view name) {
+  return FindStop(name);
+}
+
+const Bus& Catalogue::GetBus(BusId id) const {
+  assert(id < buses_.size());
+  return buses_[id];
+}
+
+const Stop& Catalogue::GetStop(StopId id) const {
+  assert(id < stops_.size());
+  return stops_[id];
+}
+
+void Catalogue::SetDistance(string_view from, string_view to,
+                            uint32_t distance) {
+  const Stop* from_ptr = FindStop(from);
+  const Stop* to_ptr = FindStop(to);
+  if (from_ptr != nullptr && to_ptr != nullptr) {
+    SetDistance(from_ptr->id, to_ptr->id, distance);
   } else {
-    return iter->second;
+    pendingRoads_.push_back({string(from), string(to), distance});
   }
 }
 
-Stop* Catalogue::GetStopData(const string& name) {
-  auto iter = stopsPtr_.find(name);
-  if (iter == stopsPtr_.end()) {
-    return nullptr;
-  } else {
-    return iter->second;
+void Catalogue::SetDistance(StopId from, StopId to, uint32_t distance) {
+  roads_.push_back({from, to, distance});
+  roadsChanged_ = true;
+}
+
+namespace {
+
+// Раскладывает элементы по группам за один проход, сохраняя их порядок
+// внутри группы. Возвращает начала групп, последний элемент - общее число
+template <typename Item, typename GroupOf>
+vector<uint32_t> GroupItems(const vector<Item>& items, size_t group_count,
+                            GroupOf group_of, vector<Item>& grouped) {
+  vector<uint32_t> offsets(group_count + 1, 0);
+  for (const Item& item : items) {
+    ++offsets[group_of(item) + 1];
+  }
+  partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+  vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+  grouped.resize(items.size());
+  for (const Item& item : items) {
+    grouped[fill[group_of(item)]++] = item;
   }
+  return offsets;
 }
 
-void Catalogue::SetDistance(const pair<string, string>& stops,
-                            uint32_t distance) {
-  pair<Stop*, Stop*> stopPtrs(FindStop(stops.first), FindStop(stops.second));
-  distanceBetweenStops_[stopPtrs] = distance;
-}
-
-uint32_t Catalogue::GetDistance(const pair<string, string>& stops) {
-  pair<Stop*, Stop*> stopPtrs(FindStop(stops.first), FindStop(stops.second));
-  auto iter = distanceBetweenStops_.find(stopPtrs);
-  if (iter == distanceBetweenStops_.end()) {
-    pair<Stop*, Stop*> stopPtrsBackwards(FindStop(stops.second),
-                                         FindStop(stops.first));
-    auto iterBackwards = distanceBetweenStops_.find(stopPtrsBackwards);
-    if (iterBackwards == distanceBetweenStops_.end()) {
-      return 0;
-    } else {
-      return iterBackwards->second;
+}  // namespace
+
+void Catalogue::BuildRoads() const {
+  auto by_target = [](const RoadTarget& lhs, const RoadTarget& rhs) {
+    return lhs.to < rhs.to;
+  };
+
+  // Заданные расстояния по начальной остановке. Из повторно заданных
+  // действует последнее, поэтому сортировка устойчивая
+  vector<Road> given;
+  const vector<uint32_t> given_offsets = GroupItems(
+      roads_, stops_.size(), [](const Road& road) { return road.from; }, given);
+  vector<RoadTarget> targets;
+  targets.reserve(given.size());
+  vector<uint32_t> offsets(stops_.size() + 1, 0);
+  vector<RoadTarget> group;
+  for (size_t stop = 0; stop < stops_.size(); ++stop) {
+    group.clear();
+    for (uint32_t i = given_offsets[stop]; i < given_offsets[stop + 1]; ++i) {
+      group.push_back({given[i].to, given[i].distance});
     }
-  } else {
-    return iter->second;
+    stable_sort(group.begin(), group.end(), by_target);
+    for (const RoadTarget& target : group) {
+      if (targets.size() > offsets[stop] && targets.back().to == target.to) {
+        targets.back() = target;
+      } else {
+        targets.push_back(target);
+      }
+    }
+    offsets[stop + 1] = targets.size();
+  }
+
+  auto find_target = [&](StopId from, StopId to) {
+    return binary_search(targets.begin() + offsets[from],
+                         targets.begin() + offsets[from + 1],
+                         RoadTarget{to, 0}, by_target);
+  };
+
+  // Направления, заданные только в одну сторону, дополняются обратными
+  vector<Road> backwards;
+  for (size_t stop = 0; stop < stops_.size(); ++stop) {
+    for (uint32_t i = offsets[stop]; i < offsets[stop + 1]; ++i) {
+      if (!find_target(targets[i].to, StopId(stop))) {
+        backwards.push_back({targets[i].to, StopId(stop), targets[i].distance});
+      }
+    }
+  }
+  vector<Road> backwards_grouped;
+  const vector<uint32_t> backwards_offsets = GroupItems(
+      backwards, stops_.size(), [](const Road& road) { return road.from; },
+      backwards_grouped);
+
+  roadOffsets_.assign(stops_.size() + 1, 0);
+  roadTargets_.clear();
+  roadTargets_.reserve(targets.size() + backwards.size());
+  for (size_t stop = 0; stop < stops_.size(); ++stop) {
+    const auto first = roadTargets_.end() - roadTargets_.begin();
+    roadTargets_.insert(roadTargets_.end(), targets.begin() + offsets[stop],
+                        targets.begin() + offsets[stop + 1]);
+    for (uint32_t i = backwards_offsets[stop];
+         i < backwards_offsets[stop + 1]; ++i) {
+      roadTargets_.push_back({backwards_grouped[i].to,
+                              backwards_grouped[i].distance});
+    }
+    sort(roadTargets_.begin() + first, roadTargets_.end(), by_target);
+    roadOffsets_[stop + 1] = roadTargets_.size();
   }
+  roadsChanged_ = false;
+}
+
+uint32_t Catalogue::GetDistance(StopId from, StopId to) const {
+  if (roadsChanged_) {
+    BuildRoads();
+  }
+  if (size_t(from) + 1 >= roadOffsets_.size()) {
+    return 0;
+  }
+  return FindDistance(Span<RoadTarget>(roadTargets_.data() + roadOffsets_[from],
+                                       roadTargets_.data() + roadOffsets_[from + 1]),
+                      to);
+}
+
+shared_ptr<const Snapshot> Catalogue::Freeze() {
+  Finalize();
+  if (roadsChanged_ || roadOffsets_.size() != stops_.size() + 1) {
+    BuildRoads();
+  }
+  Snapshot::Data data;
+
+  data.stop_names.reserve(stops_.size());
+  data.latitudes.reserve(stops_.size());
+  data.longitudes.reserve(stops_.size());
+  data.stop_bus_offsets.reserve(stops_.size() + 1);
+  data.stop_bus_offsets.push_back(0);
+  for (const Stop& stop : stops_) {
+    data.stop_names.push_back(stop.name);
+    data.stop_removed.push_back(stop.removed);
+    data.latitudes.push_back(stop.coord.lat);
+    data.longitudes.push_back(stop.coord.lng);
+    data.stop_buses.insert(data.stop_buses.end(), stop.buses.begin(),
+                           stop.buses.end());
+    data.stop_bus_offsets.push_back(data.stop_buses.size());
+  }
+
+  data.bus_names.reserve(buses_.size());
+  data.bus_stats.reserve(buses_.size());
+  data.bus_roundtrips.reserve(buses_.size());
+  data.bus_stop_offsets.reserve(buses_.size() + 1);
+  data.bus_stop_offsets.push_back(0);
+  for (const Bus& bus : buses_) {
+    data.bus_names.push_back(bus.name);
+    data.bus_stats.push_back(
+        {bus.stopsOnRoute, bus.uniqueStops, bus.routeLength, bus.curvature});
+    data.bus_roundtrips.push_back(bus.isRoundtrip);
+    data.bus_removed.push_back(bus.removed);
+    data.bus_stops.insert(data.bus_stops.end(), bus.stops.begin(),
+                          bus.stops.end());
+    data.bus_stop_offsets.push_back(data.bus_stops.size());
+  }
+
+  data.road_offsets = roadOffsets_;
+  data.road_targets = roadTargets_;
+  return make_shared<const Snapshot>(data);
 }
 
 }  // namespace transport
@@ -0,0 +1,804 @@
+#include "transport_snapshot.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <numeric>
+#include <stdexcept>
+
+#include "mapped_file.h"
+
+using namespace std;
+
+namespace transport {
+
+namespace {
+
+// Имён в корзине в среднем столько
+constexpr size_t BUCKET_SIZE = 4;
+// Если для корзины не нашлось сдвига, таблица строится с другим зерном
+constexpr uint32_t MAX_DISPLACEMENT = 1 << 16;
+constexpr int MAX_ATTEMPTS = 8;
+// Соседей остановки обычно немного, их проще перебрать подряд
+constexpr size_t LINEAR_SEARCH_LIMIT = 16;
+
+uint64_t Mix(uint64_t value) {
+  value ^= value >> 33;
+  value *= 0xff51afd7ed558ccdULL;
+  value ^= value >> 33;
+  value *= 0xc4ceb9fe1a85ec53ULL;
+  value ^= value >> 33;
+  return value;
+}
+
+// Из одинаковых имён остаётся первое, удалённые пропускаются
+vector<uint32_t> SortByName(const vector<string_view>& names,
+                            const vector<uint8_t>& removed = {}) {
+  vector<uint32_t> ids;
+  ids.reserve(names.size());
+  for (uint32_t id = 0; id < names.size(); ++id) {
+    if (id >= removed.size() || !removed[id]) {
+      ids.push_back(id);
+    }
+  }
+  stable_sort(ids.begin(), ids.end(), [&names](uint32_t lhs, uint32_t rhs) {
+    return names[lhs] < names[rhs];
+  });
+  ids.erase(unique(ids.begin(), ids.end(),
+                   [&names](uint32_t lhs, uint32_t rhs) {
+                     return names[lhs] == names[rhs];
+                   }),
+            ids.end());
+  return ids;
+}
+
+}  // namespace
+
+NameIndex::Table NameIndex::Build(const vector<string_view>& names) {
+  return Build(names, SortByName(names));
+}
+
+NameIndex::Table NameIndex::Build(const vector<string_view>& names,
+                                  const vector<uint32_t>& ids) {
+  Table table;
+  for (int attempt = 0; attempt < MAX_ATTEMPTS; ++attempt) {
+    table.seed = Mix(attempt + 1);
+    if (TryBuild(table, names, ids)) {
+      return table;
+    }
+  }
+  throw runtime_error("Failed to build name index"s);
+}
+
+// FNV-1a с зерном
+uint64_t NameIndex::Hash(uint64_t seed, string_view name) {
+  uint64_t hash = 0xcbf29ce484222325ULL ^ seed;
+  for (char c : name) {
+    hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ULL;
+  }
+  return Mix(hash);
+}
+
+size_t NameIndex::Slot(uint64_t hash, uint32_t displacement,
+                       size_t slot_count) {
+  return Mix(hash + displacement * 0x9e3779b97f4a7c15ULL) % slot_count;
+}
+
+bool NameIndex::TryBuild(Table& table, const vector<string_view>& names,
+                         const vector<uint32_t>& ids) {
+  const size_t bucket_count = ids.size() / BUCKET_SIZE + 1;
+  vector<uint32_t>& displacements = table.displacements;
+  vector<uint32_t>& slots = table.slots;
+  displacements.assign(bucket_count, 0);
+  // Запас в четверть позволяет быстро подбирать сдвиги
+  slots.assign(ids.size() + ids.size() / 4 + 1, EMPTY);
+
+  vector<uint64_t> hashes(names.size());
+  vector<vector<uint32_t>> buckets(bucket_count);
+  for (uint32_t id : ids) {
+    hashes[id] = Hash(table.seed, names[id]);
+    buckets[hashes[id] % bucket_count].push_back(id);
+  }
+
+  // Сначала размещаются самые большие корзины, пока свободных ячеек много
+  vector<uint32_t> order(bucket_count);
+  iota(order.begin(), order.end(), 0);
+  stable_sort(order.begin(), order.end(), [&buckets](uint32_t lhs, uint32_t rhs) {
+    return buckets[lhs].size() > buckets[rhs].size();
+  });
+
+  vector<size_t> taken;
+  for (uint32_t bucket : order) {
+    if (buckets[bucket].empty()) {
+      break;
+    }
+    bool placed = false;
+    for (uint32_t displacement = 0; displacement < MAX_DISPLACEMENT && !placed;
+         ++displacement) {
+      taken.clear();
+      placed = true;
+      for (uint32_t id : buckets[bucket]) {
+        const size_t slot = Slot(hashes[id], displacement, slots.size());
+        if (slots[slot] != EMPTY ||
+            find(taken.begin(), taken.end(), slot) != taken.end()) {
+          placed = false;
+          break;
+        }
+        taken.push_back(slot);
+      }
+      if (placed) {
+        displacements[bucket] = displacement;
+        for (size_t i = 0; i < taken.size(); ++i) {
+          slots[taken[i]] = buckets[bucket][i];
+        }
+      }
+    }
+    if (!placed) {
+      return false;
+    }
+  }
+  return true;
+}
+
+uint32_t FindDistance(Span<RoadTarget> targets, StopId to) {
+  const RoadTarget* iter = targets.begin();
+  if (targets.size() <= LINEAR_SEARCH_LIMIT) {
+    while (iter != targets.end() && iter->to < to) {
+      ++iter;
+    }
+  } else {
+    iter = lower_bound(targets.begin(), targets.end(), to,
+                       [](const RoadTarget& target, StopId stop) {
+                         return target.to < stop;
+                       });
+  }
+  if (iter == targets.end() || iter->to != to) {
+    return 0;
+  }
+  return iter->distance;
+}
+
+namespace {
+
+const double DEGREE = M_PI / 180.0;
+
+// Точка на единичной сфере. Хорда между точками монотонна по расстоянию
+// вдоль сферы, поэтому ближайшие ищутся по квадрату хорды
+struct UnitVector {
+  double x;
+  double y;
+  double z;
+};
+
+UnitVector ToUnitVector(double lat, double lng) {
+  const double cos_lat = cos(lat * DEGREE);
+  return {cos_lat * cos(lng * DEGREE), cos_lat * sin(lng * DEGREE),
+          sin(lat * DEGREE)};
+}
+
+double SquaredChord(const UnitVector& lhs, const UnitVector& rhs) {
+  const double dx = lhs.x - rhs.x;
+  const double dy = lhs.y - rhs.y;
+  const double dz = lhs.z - rhs.z;
+  return dx * dx + dy * dy + dz * dz;
+}
+
+// Угол между долготами в градусах, от 0 до 180
+double LongitudeGap(double lhs, double rhs) {
+  const double gap = fmod(abs(lhs - rhs), 360.0);
+  return gap > 180.0 ? 360.0 - gap : gap;
+}
+
+// Область поддерева в градусах
+struct Region {
+  double min_lat = -90.0;
+  double max_lat = 90.0;
+  double min_lng = -180.0;
+  double max_lng = 180.0;
+};
+
+bool Less(const SpatialPoint& lhs, const SpatialPoint& rhs, bool by_lat) {
+  return by_lat ? lhs.lat < rhs.lat : lhs.lng < rhs.lng;
+}
+
+void BuildTree(SpatialPoint* begin, SpatialPoint* end, bool by_lat) {
+  if (end - begin < 2) {
+    return;
+  }
+  SpatialPoint* middle = begin + (end - begin) / 2;
+  nth_element(begin, middle, end,
+              [by_lat](const SpatialPoint& lhs, const SpatialPoint& rhs) {
+                return Less(lhs, rhs, by_lat);
+              });
+  BuildTree(begin, middle, !by_lat);
+  BuildTree(middle + 1, end, !by_lat);
+}
+
+// Обход дерева с отсечением поддеревьев, которые не ближе
+// худшей из уже найденных точек
+class NearestSearch {
+ public:
+  NearestSearch(Span<SpatialPoint> points, Coordinates from, size_t count)
+      : points_(points),
+        from_(from),
+        from_vector_(ToUnitVector(from.lat, from.lng)),
+        count_(count) {
+    heap_.reserve(count);
+  }
+
+  void Run(size_t begin, size_t end, bool by_lat, const Region& region) {
+    if (begin >= end ||
+        (heap_.size() == count_ && LowerBound(region) >= heap_.front().first)) {
+      return;
+    }
+    const size_t middle = begin + (end - begin) / 2;
+    const SpatialPoint& point = points_[middle];
+    Offer(point);
+
+    Region left = region;
+    Region right = region;
+    if (by_lat) {
+      left.max_lat = right.min_lat = point.lat;
+    } else {
+      left.max_lng = right.min_lng = point.lng;
+    }
+    if (by_lat ? from_.lat < point.lat : from_.lng < point.lng) {
+      Run(begin, middle, !by_lat, left);
+      Run(middle + 1, end, !by_lat, right);
+    } else {
+      Run(middle + 1, end, !by_lat, right);
+      Run(begin, middle, !by_lat, left);
+    }
+  }
+
+  vector<SpatialIndex::Neighbor> Result() {
+    sort_heap(heap_.begin(), heap_.end());
+    vector<SpatialIndex::Neighbor> result;
+    result.reserve(heap_.size());
+    for (const auto& [chord, id] : heap_) {
+      const double half_chord = min(1.0, sqrt(chord) / 2.0);
+      result.push_back({id, 2.0 * asin(half_chord) * EarthRadius});
+    }
+    return result;
+  }
+
+ private:
+  Span<SpatialPoint> points_;
+  Coordinates from_;
+  UnitVector from_vector_;
+  size_t count_;
+  // Квадраты хорд до найденных точек, сверху самая дальняя
+  vector<pair<double, StopId>> heap_;
+
+  void Offer(const SpatialPoint& point) {
+    const double chord =
+        SquaredChord(from_vector_, ToUnitVector(point.lat, point.lng));
+    if (heap_.size() < count_) {
+      heap_.push_back({chord, point.id});
+      push_heap(heap_.begin(), heap_.end());
+    } else if (chord < heap_.front().first) {
+      pop_heap(heap_.begin(), heap_.end());
+      heap_.back() = {chord, point.id};
+      push_heap(heap_.begin(), heap_.end());
+    }
+  }
+
+  // Квадрат хорды до любой точки области не меньше суммы квадратов
+  // расстояний по оси z и в плоскости экватора. По z ближе всего
+  // ближайшая широта области, в плоскости - ближайший луч-меридиан
+  double LowerBound(const Region& region) const {
+    const double lat = clamp(from_.lat, region.min_lat, region.max_lat);
+    const double dz = from_vector_.z - sin(lat * DEGREE);
+    double dxy = 0.0;
+    if (from_.lng < region.min_lng || from_.lng > region.max_lng) {
+      const double gap = min(LongitudeGap(from_.lng, region.min_lng),
+                             LongitudeGap(from_.lng, region.max_lng));
+      const double radius = cos(from_.lat * DEGREE);
+      dxy = gap >= 90.0 ? radius : radius * sin(gap * DEGREE);
+    }
+    return dz * dz + dxy * dxy;
+  }
+};
+
+void CollectInBox(Span<SpatialPoint> points, size_t begin, size_t end,
+                  bool by_lat, Coordinates min, Coordinates max,
+                  vector<StopId>& result) {
+  if (begin >= end) {
+    return;
+  }
+  const size_t middle = begin + (end - begin) / 2;
+  const SpatialPoint& point = points[middle];
+  if (min.lat <= point.lat && point.lat <= max.lat && min.lng <= point.lng &&
+      point.lng <= max.lng) {
+    result.push_back(point.id);
+  }
+  const double value = by_lat ? point.lat : point.lng;
+  if ((by_lat ? min.lat : min.lng) <= value) {
+    CollectInBox(points, begin, middle, !by_lat, min, max, result);
+  }
+  if ((by_lat ? max.lat : max.lng) >= value) {
+    CollectInBox(points, middle + 1, end, !by_lat, min, max, result);
+  }
+}
+
+}  // namespace
+
+void SpatialIndex::Build(vector<SpatialPoint>& points) {
+  BuildTree(points.data(), points.data() + points.size(), true);
+}
+
+vector<SpatialIndex::Neighbor> SpatialIndex::Nearest(Coordinates from,
+                                                     size_t count) const {
+  if (count == 0) {
+    return {};
+  }
+  // Долгота запроса приводится к [-180, 180], как у остановок
+  from.lng = remainder(from.lng, 360.0);
+  NearestSearch search(points_, from, min(count, points_.size()));
+  search.Run(0, points_.size(), true, Region{});
+  return search.Result();
+}
+
+vector<StopId> SpatialIndex::InBox(Coordinates min, Coordinates max) const {
+  vector<StopId> result;
+  if (min.lat > max.lat) {
+    return result;
+  }
+  if (min.lng <= max.lng) {
+    CollectInBox(points_, 0, points_.size(), true, min, max, result);
+  } else {
+    CollectInBox(points_, 0, points_.size(), true, min,
+                 Coordinates{max.lat, 180.0}, result);
+    CollectInBox(points_, 0, points_.size(), true,
+                 Coordinates{min.lat, -180.0}, max, result);
+  }
+  return result;
+}
+
+namespace {
+
+// Разделы образа в порядке следования
+enum Section : uint32_t {
+  STOP_NAME_OFFSETS,
+  STOP_NAMES,
+  BUS_NAME_OFFSETS,
+  BUS_NAMES,
+  LATITUDES,
+  LONGITUDES,
+  STOP_BUS_OFFSETS,
+  STOP_BUSES,
+  BUS_STOP_OFFSETS,
+  BUS_STOPS,
+  BUS_ROUNDTRIPS,
+  BUS_STATS,
+  ROAD_OFFSETS,
+  ROAD_TARGETS,
+  STOPS_BY_NAME,
+  BUSES_BY_NAME,
+  STOP_INDEX_SEED,
+  STOP_INDEX_DISPLACEMENTS,
+  STOP_INDEX_SLOTS,
+  BUS_INDEX_SEED,
+  BUS_INDEX_DISPLACEMENTS,
+  BUS_INDEX_SLOTS,
+  STOP_POINTS,
+  UP_OFFSETS,
+  UP_EDGES,
+  DOWN_OFFSETS,
+  DOWN_EDGES,
+  STOP_RANKS,
+  RANKED_STOPS,
+  CORE_RANK,
+  // Всегда последний: Save дописывает его после остальных
+  SETTINGS,
+  SECTION_COUNT,
+};
+
+constexpr char MAGIC[8] = {'T', 'C', 'S', 'N', 'A', 'P', '\0', '\0'};
+// Записывается как есть: на машине с другим порядком байтов не совпадёт
+constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+constexpr size_t ALIGNMENT = 8;
+
+struct SectionEntry {
+  uint64_t offset;
+  uint64_t size;
+};
+
+struct Header {
+  char magic[8];
+  uint32_t byte_order;
+  uint32_t version;
+  uint32_t section_count;
+  uint32_t reserved;
+  // Считается по всему образу с нулевым checksum, см. Checksum
+  uint64_t checksum;
+  SectionEntry sections[SECTION_COUNT];
+};
+
+// Разделы иерархии идут подряд перед настройками, см. Snapshot::Save
+constexpr Section HIERARCHY_SECTIONS[] = {UP_OFFSETS,   UP_EDGES,
+                                          DOWN_OFFSETS, DOWN_EDGES,
+                                          STOP_RANKS,   RANKED_STOPS,
+                                          CORE_RANK};
+static_assert(CORE_RANK + 1 == SETTINGS);
+
+static_assert(sizeof(Header) % ALIGNMENT == 0);
+static_assert(sizeof(Snapshot::BusStats) == 24);
+static_assert(sizeof(RoadTarget) == 8);
+static_assert(sizeof(SpatialPoint) == 24);
+static_assert(sizeof(HierarchyEdge) == 16);
+
+size_t Align(size_t size) {
+  return (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+template <typename T>
+string_view Bytes(const T* items, size_t count) {
+  return {reinterpret_cast<const char*>(items), count * sizeof(T)};
+}
+
+template <typename T>
+string_view Bytes(const vector<T>& items) {
+  return Bytes(items.data(), items.size());
+}
+
+// Контрольная сумма по 8-байтовым словам. Шаг обратим при любом слове,
+// поэтому замена одного слова меняет сумму всегда, а остальные порчи
+// остаются незамеченными с вероятностью порядка 2^-64
+class Checksum {
+ public:
+  void Add(string_view bytes) {
+    size_ += bytes.size();
+    if (pending_size_ != 0) {
+      const size_t count = min(bytes.size(), sizeof(pending_) - pending_size_);
+      memcpy(pending_ + pending_size_, bytes.data(), count);
+      pending_size_ += count;
+      bytes.remove_prefix(count);
+      if (pending_size_ < sizeof(pending_)) {
+        return;
+      }
+      AddWord(pending_);
+      pending_size_ = 0;
+    }
+    const size_t whole = bytes.size() - bytes.size() % sizeof(pending_);
+    for (size_t i = 0; i < whole; i += sizeof(pending_)) {
+      AddWord(bytes.data() + i);
+    }
+    pending_size_ = bytes.size() - whole;
+    memcpy(pending_, bytes.data() + whole, pending_size_);
+  }
+
+  uint64_t Finish() {
+    if (pending_size_ != 0) {
+      memset(pending_ + pending_size_, 0, sizeof(pending_) - pending_size_);
+      AddWord(pending_);
+      pending_size_ = 0;
+    }
+    return Mix(hash_ ^ size_);
+  }
+
+ private:
+  uint64_t hash_ = 0;
+  uint64_t size_ = 0;
+  char pending_[8];
+  size_t pending_size_ = 0;
+
+  void AddWord(const char* bytes) {
+    uint64_t word;
+    memcpy(&word, bytes, sizeof(word));
+    hash_ = (hash_ ^ word) * 0x9e3779b97f4a7c15ULL;
+    hash_ ^= hash_ >> 29;
+  }
+};
+
+// Собирает образ: разделы дописываются по порядку, каждый с выровненного
+// смещения, а заголовок заполняется по ходу
+class ImageWriter {
+ public:
+  ImageWriter() : image_(sizeof(Header), '\0') {
+    Header header{};
+    copy(begin(MAGIC), end(MAGIC), header.magic);
+    header.byte_order = BYTE_ORDER_MARK;
+    header.version = Snapshot::VERSION;
+    header.section_count = SECTION_COUNT;
+    memcpy(image_.data(), &header, sizeof(header));
+  }
+
+  template <typename T>
+  void Add(Section section, const T* items, size_t count) {
+    const size_t size = count * sizeof(T);
+    image_.resize(Align(image_.size()));
+    const SectionEntry entry{image_.size(), size};
+    memcpy(image_.data() + offsetof(Header, sections) +
+               section * sizeof(SectionEntry),
+           &entry, sizeof(entry));
+    image_.append(reinterpret_cast<const char*>(items), size);
+  }
+
+  template <typename T>
+  void Add(Section section, const vector<T>& items) {
+    Add(section, items.data(), items.size());
+  }
+
+  void AddNames(Section offsets_section, Section chars_section,
+                const vector<string_view>& names) {
+    vector<uint32_t> offsets;
+    offsets.reserve(names.size() + 1);
+    offsets.push_back(0);
+    string chars;
+    for (string_view name : names) {
+      chars += name;
+      offsets.push_back(chars.size());
+    }
+    Add(offsets_section, offsets);
+    Add(chars_section, chars.data(), chars.size());
+  }
+
+  void AddIndex(Section seed_section, const NameIndex::Table& table) {
+    Add(seed_section, &table.seed, 1);
+    Add(Section(seed_section + 1), table.displacements);
+    Add(Section(seed_section + 2), table.slots);
+  }
+
+  string Finish() {
+    Add(SETTINGS, "", 0);
+    Checksum checksum;
+    checksum.Add(image_);
+    const uint64_t sum = checksum.Finish();
+    memcpy(image_.data() + offsetof(Header, checksum), &sum, sizeof(sum));
+    return move(image_);
+  }
+
+ private:
+  string image_;
+};
+
+// Разбирает заголовок образа и проверяет, что разделы не выходят за него
+class ImageReader {
+ public:
+  explicit ImageReader(string_view image) : image_(image) {
+    if (image.size() < sizeof(Header)) {
+      throw runtime_error("Snapshot image is truncated"s);
+    }
+    if (reinterpret_cast<uintptr_t>(image.data()) % ALIGNMENT != 0) {
+      throw runtime_error("Snapshot image is not aligned"s);
+    }
+    memcpy(&header_, image.data(), sizeof(header_));
+    if (!equal(begin(MAGIC), end(MAGIC), header_.magic)) {
+      throw runtime_error("Not a snapshot image"s);
+    }
+    if (header_.byte_order != BYTE_ORDER_MARK) {
+      throw runtime_error("Snapshot image has foreign byte order"s);
+    }
+    if (header_.version != Snapshot::VERSION ||
+        header_.section_count != SECTION_COUNT) {
+      throw runtime_error("Unsupported snapshot version "s +
+                          to_string(header_.version));
+    }
+    for (const SectionEntry& entry : header_.sections) {
+      if (entry.offset % ALIGNMENT != 0 || entry.offset > image.size() ||
+          entry.size > image.size() - entry.offset) {
+        throw runtime_error("Snapshot section is out of image"s);
+      }
+    }
+  }
+
+  template <typename T>
+  Span<T> Get(Section section) const {
+    const SectionEntry& entry = header_.sections[section];
+    if (entry.size % sizeof(T) != 0) {
+      throw runtime_error("Snapshot section has wrong size"s);
+    }
+    const T* begin = reinterpret_cast<const T*>(image_.data() + entry.offset);
+    return Span<T>(begin, begin + entry.size / sizeof(T));
+  }
+
+  NameTable GetNames(Section offsets_section, Section chars_section) const {
+    const Span<uint32_t> offsets = Get<uint32_t>(offsets_section);
+    const Span<char> chars = Get<char>(chars_section);
+    Check(!offsets.empty() && offsets.back() <= chars.size());
+    return NameTable(offsets, chars);
+  }
+
+  NameIndex GetIndex(Section seed_section) const {
+    const Span<uint64_t> seed = Get<uint64_t>(seed_section);
+    const Span<uint32_t> displacements =
+        Get<uint32_t>(Section(seed_section + 1));
+    const Span<uint32_t> slots = Get<uint32_t>(Section(seed_section + 2));
+    Check(seed.size() == 1 && !displacements.empty() && !slots.empty());
+    return NameIndex(seed.front(), displacements, slots);
+  }
+
+  // Проход по всему образу, поэтому только для файлов
+  void CheckSum() const {
+    Checksum checksum;
+    Header header = header_;
+    header.checksum = 0;
+    checksum.Add(string_view(reinterpret_cast<const char*>(&header),
+                             sizeof(header)));
+    checksum.Add(image_.substr(sizeof(header)));
+    if (checksum.Finish() != header_.checksum) {
+      throw runtime_error("Snapshot image is damaged"s);
+    }
+  }
+
+  static void Check(bool condition) {
+    if (!condition) {
+      throw runtime_error("Snapshot image is inconsistent"s);
+    }
+  }
+
+ private:
+  string_view image_;
+  Header header_;
+};
+
+shared_ptr<const string> BuildImage(const Snapshot::Data& data) {
+  ImageWriter writer;
+  writer.AddNames(STOP_NAME_OFFSETS, STOP_NAMES, data.stop_names);
+  writer.AddNames(BUS_NAME_OFFSETS, BUS_NAMES, data.bus_names);
+  writer.Add(LATITUDES, data.latitudes);
+  writer.Add(LONGITUDES, data.longitudes);
+  writer.Add(STOP_BUS_OFFSETS, data.stop_bus_offsets);
+  writer.Add(STOP_BUSES, data.stop_buses);
+  writer.Add(BUS_STOP_OFFSETS, data.bus_stop_offsets);
+  writer.Add(BUS_STOPS, data.bus_stops);
+  writer.Add(BUS_ROUNDTRIPS, data.bus_roundtrips);
+  writer.Add(BUS_STATS, data.bus_stats);
+  writer.Add(ROAD_OFFSETS, data.road_offsets);
+  writer.Add(ROAD_TARGETS, data.road_targets);
+  const vector<uint32_t> stops_by_name =
+      SortByName(data.stop_names, data.stop_removed);
+  const vector<uint32_t> buses_by_name =
+      SortByName(data.bus_names, data.bus_removed);
+  writer.Add(STOPS_BY_NAME, stops_by_name);
+  writer.Add(BUSES_BY_NAME, buses_by_name);
+  writer.AddIndex(STOP_INDEX_SEED,
+                  NameIndex::Build(data.stop_names, stops_by_name));
+  writer.AddIndex(BUS_INDEX_SEED,
+                  NameIndex::Build(data.bus_names, buses_by_name));
+  vector<SpatialPoint> points;
+  points.reserve(stops_by_name.size());
+  for (StopId stop : stops_by_name) {
+    points.push_back({data.latitudes[stop], data.longitudes[stop], stop, 0});
+  }
+  SpatialIndex::Build(points);
+  writer.Add(STOP_POINTS, points);
+  // Иерархия сжатий пустая, её добавляет Save
+  for (Section section : HIERARCHY_SECTIONS) {
+    writer.Add(section, "", 0);
+  }
+  return make_shared<const string>(writer.Finish());
+}
+
+}  // namespace
+
+Snapshot::Snapshot(const Data& data) : Snapshot(BuildImage(data)) {}
+
+Snapshot::Snapshot(shared_ptr<const string> image) : Snapshot(image, *image) {}
+
+// Проверяются только размеры разделов: порчу содержимого файла
+// находит контрольная сумма в Load
+Snapshot::Snapshot(shared_ptr<const void> owner, string_view image)
+    : owner_(move(owner)), image_(image) {
+  const ImageReader reader(image);
+  stop_names_ = reader.GetNames(STOP_NAME_OFFSETS, STOP_NAMES);
+  bus_names_ = reader.GetNames(BUS_NAME_OFFSETS, BUS_NAMES);
+  latitudes_ = reader.Get<double>(LATITUDES);
+  longitudes_ = reader.Get<double>(LONGITUDES);
+  stop_bus_offsets_ = reader.Get<uint32_t>(STOP_BUS_OFFSETS);
+  stop_buses_ = reader.Get<BusId>(STOP_BUSES);
+  bus_stop_offsets_ = reader.Get<uint32_t>(BUS_STOP_OFFSETS);
+  bus_stops_ = reader.Get<StopId>(BUS_STOPS);
+  bus_roundtrips_ = reader.Get<uint8_t>(BUS_ROUNDTRIPS);
+  bus_stats_ = reader.Get<BusStats>(BUS_STATS);
+  road_offsets_ = reader.Get<uint32_t>(ROAD_OFFSETS);
+  road_targets_ = reader.Get<RoadTarget>(ROAD_TARGETS);
+  stops_by_name_ = reader.Get<StopId>(STOPS_BY_NAME);
+  buses_by_name_ = reader.Get<BusId>(BUSES_BY_NAME);
+  stop_index_ = reader.GetIndex(STOP_INDEX_SEED);
+  bus_index_ = reader.GetIndex(BUS_INDEX_SEED);
+  const Span<SpatialPoint> points = reader.Get<SpatialPoint>(STOP_POINTS);
+  spatial_index_ = SpatialIndex(points);
+  const Span<uint32_t> up_offsets = reader.Get<uint32_t>(UP_OFFSETS);
+  const Span<HierarchyEdge> up_edges = reader.Get<HierarchyEdge>(UP_EDGES);
+  const Span<uint32_t> down_offsets = reader.Get<uint32_t>(DOWN_OFFSETS);
+  const Span<HierarchyEdge> down_edges =
+      reader.Get<HierarchyEdge>(DOWN_EDGES);
+  const Span<uint32_t> ranks = reader.Get<uint32_t>(STOP_RANKS);
+  const Span<StopId> ranked_stops = reader.Get<StopId>(RANKED_STOPS);
+  const Span<uint32_t> core_rank = reader.Get<uint32_t>(CORE_RANK);
+  if (!up_offsets.empty()) {
+    ImageReader::Check(core_rank.size() == 1);
+    road_hierarchy_ = RoadHierarchy(up_offsets, up_edges, down_offsets,
+                                    down_edges, ranks, ranked_stops,
+                                    core_rank.front());
+  }
+  const Span<char> settings = reader.Get<char>(SETTINGS);
+  settings_ = string_view(settings.begin(), settings.size());
+
+  const size_t stops = stop_names_.size();
+  const size_t buses = bus_names_.size();
+  ImageReader::Check(latitudes_.size() == stops && longitudes_.size() == stops);
+  ImageReader::Check(stop_bus_offsets_.size() == stops + 1 &&
+                     stop_bus_offsets_.back() <= stop_buses_.size());
+  ImageReader::Check(road_offsets_.size() == stops + 1 &&
+                     road_offsets_.back() <= road_targets_.size());
+  ImageReader::Check(bus_stop_offsets_.size() == buses + 1 &&
+                     bus_stop_offsets_.back() <= bus_stops_.size());
+  ImageReader::Check(bus_roundtrips_.size() == buses &&
+                     bus_stats_.size() == buses);
+  ImageReader::Check(stops_by_name_.size() <= stops &&
+                     buses_by_name_.size() <= buses);
+  ImageReader::Check(points.size() == stops_by_name_.size());
+  if (!road_hierarchy_.empty()) {
+    ImageReader::Check(up_offsets.size() == stops + 1 &&
+                       up_offsets.back() <= up_edges.size());
+    ImageReader::Check(down_offsets.size() == stops + 1 &&
+                       down_offsets.back() <= down_edges.size());
+    ImageReader::Check(ranks.size() == stops && ranked_stops.size() == stops &&
+                       core_rank.front() <= stops);
+  }
+}
+
+shared_ptr<const Snapshot> Snapshot::Load(const string& path) {
+  auto file = make_shared<const MappedFile>(path);
+  const string_view image = file->GetData();
+  ImageReader(image).CheckSum();
+  return shared_ptr<const Snapshot>(new Snapshot(move(file), image));
+}
+
+// Образ до разделов иерархии пишется как есть, а они и настройки,
+// которые идут последними, - заново со своими смещениями
+void Snapshot::Save(ostream& output, string_view settings,
+                    const Hierarchy* hierarchy) const {
+  Header header;
+  memcpy(&header, image_.data(), sizeof(header));
+  vector<string_view> tail;
+  if (hierarchy != nullptr) {
+    tail = {Bytes(hierarchy->up_offsets),   Bytes(hierarchy->up_edges),
+            Bytes(hierarchy->down_offsets), Bytes(hierarchy->down_edges),
+            Bytes(hierarchy->ranks),        Bytes(hierarchy->stops),
+            Bytes(&hierarchy->core_rank, 1)};
+  } else {
+    for (Section section : HIERARCHY_SECTIONS) {
+      const SectionEntry& entry = header.sections[section];
+      tail.push_back(image_.substr(entry.offset, entry.size));
+    }
+  }
+  tail.push_back(settings);
+
+  const uint64_t body_size = header.sections[HIERARCHY_SECTIONS[0]].offset;
+  const string_view header_bytes(reinterpret_cast<const char*>(&header),
+                                 sizeof(header));
+  static const char PADDING[ALIGNMENT] = {};
+  vector<string_view> pieces = {
+      header_bytes, image_.substr(sizeof(header), body_size - sizeof(header))};
+  uint64_t offset = body_size;
+  for (size_t i = 0; i < tail.size(); ++i) {
+    pieces.push_back(string_view(PADDING, Align(offset) - offset));
+    pieces.push_back(tail[i]);
+    offset = Align(offset);
+    const Section section =
+        i < size(HIERARCHY_SECTIONS) ? HIERARCHY_SECTIONS[i] : SETTINGS;
+    header.sections[section] = {offset, tail[i].size()};
+    offset += tail[i].size();
+  }
+
+  header.checksum = 0;
+  Checksum checksum;
+  for (string_view piece : pieces) {
+    checksum.Add(piece);
+  }
+  header.checksum = checksum.Finish();
+  for (string_view piece : pieces) {
+    output.write(piece.data(), piece.size());
+  }
+  if (!output) {
+    throw runtime_error("Failed to write snapshot"s);
+  }
+}
+
+}  // namespace transport
@@ -1,13 +1,27 @@
 #pragma once
 
 #include <cassert>
+#include <cmath>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <memory_resource>
+#include <optional>
+#include <random>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <type_traits>
 
 #include "json.h"
+#include "json_builder.h"
+#include "json_stream_builder.h"
 #include "json_reader.h"
 #include "map_renderer.h"
+#include "mapped_file.h"
 #include "request_handler.h"
+#include "road_router.h"
+#include "snapshot_versions.h"
 #include "transport_catalogue.h"
 
 namespace transport {
@@ -25,6 +39,25 @@ void Test_8();
 void Test_9();
 void Test_10();
 void Test_11();
+void Test_12();
+void Test_13();
+void Test_15();
+void Test_16();
+void Test_17();
+void Test_18();
+void Test_19();
+void Test_20();
+void Test_21();
+void Test_22();
+void Test_23();
+void Test_24();
+void Test_25();
+void Test_26();
+void Test_27();
+void Test_28();
+void Test_29();
+void Test_30();
+void Test_31();
 
 }  // namespace tests
 }  // namespace transport
@@ -20,7 +20,10 @@ void Test() {
   assert(bus_ptr->uniqueStops = 2);
 
   Stop* stop_ptr = tc.GetStopData("Ривьерский мост"s);
-  assert(stop_ptr->buses.find("114"s) != stop_ptr->buses.end());
+  assert(stop_ptr->buses.size() == 1);
+  assert(tc.GetBus(stop_ptr->buses.front()).name == "114"s);
+  assert(tc.GetStop(bus_ptr->stops.front()).name == "Морской вокзал"s);
+  assert(tc.GetDistance(bus_ptr->stops[0], bus_ptr->stops[1]) == 850);
 }
 
 void Test_1() {
@@ -251,5 +254,1023 @@ void Test_11() {
   assert(doc_check == doc_expect);*/
 }
 
+void Test_12() {
+  std::ifstream in("inout/test_11_input.json");
+  assert(in.is_open());
+  json::Document doc_stream{nullptr};
+  {
+    LOG_DURATION("Load stream"s);
+    doc_stream = json::Load(in);
+  }
+  json::Document doc_mapped{nullptr};
+  {
+    LOG_DURATION("Load mapped"s);
+    doc_mapped = json::LoadFile("inout/test_11_input.json"s);
+  }
+  assert(doc_stream == doc_mapped);
+
+  const std::string text = R"({"a" : [1, -2.5e1, "x\"y\n", true, null], "b": {}})"s;
+  json::Document doc = json::Load(std::string_view{text});
+  const json::Array& array = doc.GetRoot().AsDict().at("a"s).AsArray();
+  assert(array.at(0).IsInt() && array.at(0).AsInt() == 1);
+  assert(array.at(1).IsPureDouble() && array.at(1).AsDouble() == -25.0);
+  assert(array.at(2).AsString() == "x\"y\n"s);
+  assert(array.at(3).AsBool());
+  assert(array.at(4).IsNull());
+  assert(doc.GetRoot().AsDict().at("b"s).AsDict().empty());
+}
+
+void Test_13() {
+  class Recorder final : public json::Handler {
+   public:
+    std::string events;
+
+    void StartDict() override { events += '{'; }
+    void Key(std::string key) override { events += key + ':'; }
+    void EndDict() override { events += '}'; }
+    void StartArray() override { events += '['; }
+    void EndArray() override { events += ']'; }
+    void Value(json::Node value) override {
+      events += value.IsInt() ? std::to_string(value.AsInt()) : "v"s;
+    }
+  };
+
+  Recorder recorder;
+  json::Parse(R"({"a": [1, {"b": null}], "c": "d"})"sv, recorder);
+  assert(recorder.events == "{a:[1{b:v}]c:v}"s);
+}
+
+void Test_15() {
+  const MappedFile file("inout/test_11_input.json"s);
+  const std::string_view input = file.GetData();
+
+  std::optional<json::Document> doc_heap;
+  {
+    LOG_DURATION("Load heap"s);
+    doc_heap = json::Load(input);
+  }
+  std::optional<json::Document> doc_arena;
+  {
+    LOG_DURATION("Load arena"s);
+    doc_arena = json::Load(input, std::make_unique<std::pmr::monotonic_buffer_resource>());
+  }
+  assert(*doc_heap == *doc_arena);
+  {
+    LOG_DURATION("Destroy heap"s);
+    doc_heap.reset();
+  }
+  {
+    LOG_DURATION("Destroy arena"s);
+    doc_arena.reset();
+  }
+
+  auto arena = std::make_unique<std::pmr::monotonic_buffer_resource>();
+  json::Node node = json::Builder{arena.get()}
+                        .StartDict()
+                        .Key("key"s)
+                        .StartArray()
+                        .Value(1)
+                        .EndArray()
+                        .EndDict()
+                        .Build();
+  assert(node.AsDict().get_allocator().resource() == arena.get());
+  assert(node.AsDict().at("key"s).AsArray().get_allocator().resource() == arena.get());
+  const json::Document doc{std::move(node), std::move(arena)};
+  assert(doc.GetRoot().AsDict().at("key"s).AsArray().at(0).AsInt() == 1);
+}
+
+void Test_16() {
+  json::Dict small{{"b"s, 2}, {"a"s, 1}, {"c"s, 3}};
+  std::string keys;
+  for (const auto& [key, value] : small) {
+    keys += key;
+  }
+  assert(keys == "abc"s);
+  assert(small.at("b"s).AsInt() == 2);
+  assert(small.find("d"s) == small.end());
+  small["d"s] = 4;
+  assert(small.size() == 4 && small.count("d"s) == 1);
+  assert(!small.emplace("a"s, 10).second && small.at("a"s).AsInt() == 1);
+  // Через итератор меняется только значение, ключ константный
+  static_assert(std::is_const_v<std::remove_reference_t<decltype((*small.begin()).first)>>);
+  small.find("c"s)->second = 30;
+  for (auto&& [key, value] : small) {
+    if (key == "d"s) {
+      value = 40;
+    }
+  }
+  assert(small.at("c"s).AsInt() == 30 && small.at("d"s).AsInt() == 40);
+
+  json::Dict large;
+  for (int i = 99; i >= 0; --i) {
+    large.emplace(std::to_string(i), i);
+  }
+  assert(large.size() == 100);
+  assert(large.at("42"s).AsInt() == 42);
+  assert(large.begin()->first == "0"s);
+  assert(large.find("100"s) == large.end());
+
+  try {
+    json::Load(R"({"a": 1, "b": 2, "a": 3})"sv);
+    assert(false);
+  } catch (const json::ParsingError&) {
+  }
+
+  std::ostringstream out;
+  json::Print(json::Load(R"({"z": 1, "m": {"y": 2, "b": 3}, "a": 4})"sv), out);
+  assert(json::Load(out.str()) == json::Load(R"({"a": 4, "m": {"b": 3, "y": 2}, "z": 1})"sv));
+  assert(out.str().find("\"a\"") < out.str().find("\"m\""));
+}
+
+void Test_17() {
+  const json::Document doc =
+      json::Load(R"({"b": [1, 0.1, 1.2345678901234567, 2.0], "a": "q\"\n", "c": {}})"sv);
+
+  std::ostringstream compact;
+  json::PrintSettings settings;
+  settings.compact = true;
+  json::Print(doc, compact, settings);
+  assert(compact.str() == R"({"a":"q\"\n","b":[1,0.1,1.23457,2],"c":{}})"s);
+
+  std::ostringstream exact;
+  settings.exact_doubles = true;
+  json::Print(doc, exact, settings);
+  assert(exact.str() == R"({"a":"q\"\n","b":[1,0.1,1.2345678901234567,2.0],"c":{}})"s);
+  assert(json::Load(exact.str()) == doc);
+
+  std::ostringstream pretty;
+  json::Print(json::Load(R"([{}, []])"sv), pretty);
+  assert(pretty.str() == "[\n    {\n\n    },\n    [\n\n    ]\n]"s);
+}
+
+void Test_18() {
+  std::ostringstream streamed;
+  json::StreamBuilder out(streamed);
+  out.StartArray()
+      .Value(1)
+      .StartDict()
+      .Key("a"sv)
+      .StartArray()
+      .Value("s"sv)
+      .Value(nullptr)
+      .EndArray()
+      .Key("b"sv)
+      .Value(2.5)
+      .EndDict()
+      .StartDict()
+      .EndDict()
+      .EndArray();
+  out.Finish();
+
+  std::ostringstream printed;
+  json::Print(json::Document{json::Builder{}
+                                 .StartArray()
+                                 .Value(1)
+                                 .StartDict()
+                                 .Key("a"s)
+                                 .StartArray()
+                                 .Value("s"s)
+                                 .Value(nullptr)
+                                 .EndArray()
+                                 .Key("b"s)
+                                 .Value(2.5)
+                                 .EndDict()
+                                 .StartDict()
+                                 .EndDict()
+                                 .EndArray()
+                                 .Build()},
+              printed);
+  assert(streamed.str() == printed.str());
+
+  std::ostringstream sink;
+  json::StreamBuilder bad(sink);
+  bad.StartDict();
+  bool thrown = false;
+  try {
+    bad.Value(1);
+  } catch (const std::logic_error&) {
+    thrown = true;
+  }
+  assert(thrown);
+}
+
+void Test_19() {
+  json::Node replaced = json::Builder{}
+                            .StartDict()
+                            .Key("b"s)
+                            .Value(1)
+                            .Key("a"s)
+                            .StartArray()
+                            .StartArray()
+                            .EndArray()
+                            .Value("x"s)
+                            .EndArray()
+                            .Key("b"s)
+                            .Value(2)
+                            .EndDict()
+                            .Build();
+  assert(replaced == json::Load(R"({"a": [[], "x"], "b": 2})"sv).GetRoot());
+
+  bool thrown = false;
+  json::Builder unfinished;
+  unfinished.StartDict();
+  unfinished.Key("a"s);
+  try {
+    unfinished.EndDict();
+  } catch (const std::logic_error&) {
+    thrown = true;
+  }
+  assert(thrown);
+
+  // Ответы на запросы Stop и Bus, как их собирал JsonReader
+  const std::vector<std::string> buses(12, "Bus with a long enough name"s);
+  size_t total = 0;
+  {
+    LOG_DURATION("Build 20000 responses"s);
+    for (int id = 0; id < 10000; ++id) {
+      json::Node bus = json::Builder{}
+                           .StartDict()
+                           .Key("curvature"s)
+                           .Value(1.5)
+                           .Key("request_id"s)
+                           .Value(id)
+                           .Key("route_length"s)
+                           .Value(1234.0)
+                           .Key("stop_count"s)
+                           .Value(10)
+                           .Key("unique_stop_count"s)
+                           .Value(5)
+                           .EndDict()
+                           .Build();
+      json::Builder builder;
+      auto array = builder.StartDict().Key("buses"s).StartArray();
+      for (const std::string& name : buses) {
+        array.Value(name);
+      }
+      json::Node stop =
+          array.EndArray().Key("request_id"s).Value(id).EndDict().Build();
+      total += bus.AsDict().size() + stop.AsDict().at("buses"s).AsArray().size();
+    }
+  }
+  assert(total == 10000 * (5 + buses.size()));
+}
+
+void Test_20() {
+  const json::Document small =
+      json::Load(R"({"i": [0, 23, 24, -1, -25, 2147483647, -2147483648],
+                     "d": [2.0, -0.5, 1e300], "s": ["", "строка"],
+                     "o": {"t": true, "f": false, "n": null}})"sv);
+  std::ostringstream small_out;
+  json::PrintBinary(small, small_out);
+  const json::Document small_back = json::LoadBinary(small_out.str());
+  assert(small_back == small);
+  const json::Array& doubles = small_back.GetRoot().AsDict().at("d"s).AsArray();
+  assert(doubles.at(0).IsPureDouble() && doubles.at(0).AsDouble() == 2.0);
+
+  bool thrown = false;
+  try {
+    json::LoadBinary(small_out.str().substr(0, small_out.str().size() - 1));
+  } catch (const json::ParsingError&) {
+    thrown = true;
+  }
+  assert(thrown);
+
+  const json::Document text = json::LoadFile("inout/test_11_input.json"s);
+  std::ostringstream binary_out;
+  json::PrintBinary(text, binary_out);
+  const std::string binary = binary_out.str();
+  json::Document loaded{nullptr};
+  {
+    LOG_DURATION("Load binary"s);
+    loaded = json::LoadBinary(binary);
+  }
+  assert(loaded == text);
+
+  // JsonReader сам отличает двоичный вход от текстового
+  Catalogue tc;
+  renderer::MapRenderer renderer;
+  RequestHandler handler(tc, renderer);
+  std::istringstream in(binary);
+  JsonReader reader(handler, in);
+  std::ostringstream out;
+  reader.Print(out);
+  assert(json::Load(out.str()) == json::LoadFile("inout/test_11_expect.json"s));
+
+  // Текст с меткой порядка байтов не принимается за двоичный
+  std::ostringstream text_out;
+  json::PrintSettings exact;
+  exact.exact_doubles = true;
+  json::Print(text, text_out, exact);
+  Catalogue bom_tc;
+  RequestHandler bom_handler(bom_tc, renderer);
+  std::istringstream bom_in("\xEF\xBB\xBF"s + text_out.str());
+  JsonReader bom_reader(bom_handler, bom_in);
+  std::ostringstream bom_out;
+  bom_reader.Print(bom_out);
+  assert(json::Load(bom_out.str()) == json::LoadFile("inout/test_11_expect.json"s));
+}
+
+void Test_21() {
+  Catalogue tc;
+  const StopId a = tc.AddStop("A"s, Coordinates{55.0, 37.0});
+  const StopId b = tc.AddStop("B"s, Coordinates{55.1, 37.0});
+  const StopId c = tc.AddStop("C"s, Coordinates{55.2, 37.0});
+  tc.SetDistance("A"sv, "B"sv, 100);
+  tc.SetDistance("B"sv, "C"sv, 200);
+  tc.SetDistance("C"sv, "B"sv, 300);
+  tc.SetDistance("A"sv, "B"sv, 150);
+  tc.SetDistance("A"sv, "Unknown"sv, 1);
+  assert(tc.GetDistance(a, b) == 150);
+  assert(tc.GetDistance(b, a) == 150);
+  assert(tc.GetDistance(b, c) == 200);
+  assert(tc.GetDistance(c, b) == 300);
+  assert(tc.GetDistance(a, c) == 0);
+
+  tc.SetDistance(c, a, 500);
+  assert(tc.GetDistance(a, c) == 500);
+
+  tc.AddRoute("1"s, {"A"s, "B"s, "C"s});
+  tc.Finalize();
+  assert(tc.GetBusData("1"s)->routeLength == 350);
+}
+
+void Test_22() {
+  Catalogue tc;
+  renderer::MapRenderer renderer;
+  RequestHandler handler(tc, renderer);
+  handler.AddStop("B"sv, Coordinates{55.0, 37.0});
+  handler.AddStop("A"sv, Coordinates{55.1, 37.1});
+  handler.AddStop("C"sv, Coordinates{55.2, 37.2});
+  handler.SetDistance("B"sv, "A"sv, 1000);
+  handler.AddRoute("2"sv, {"B"s, "A"s}, false);
+  handler.AddRoute("1"sv, {"A"s, "B"s, "A"s}, true);
+  handler.Freeze();
+  handler.AddStop("D"sv, Coordinates{55.3, 37.3});
+
+  const transport::Snapshot& snapshot = handler.GetSnapshot();
+  assert(snapshot.StopCount() == 3 && !snapshot.FindStop("D"sv));
+  assert(!snapshot.FindBus("3"sv) && !snapshot.FindStop(""sv));
+
+  const StopId a = *snapshot.FindStop("A"sv);
+  assert(snapshot.StopName(a) == "A"s);
+  assert(snapshot.StopCoordinates(a).lat == 55.1);
+  const transport::IdRange buses = snapshot.StopBuses(a);
+  assert(buses.size() == 2);
+  assert(snapshot.BusName(buses[0]) == "1"s && snapshot.BusName(buses[1]) == "2"s);
+  assert(snapshot.StopBuses(*snapshot.FindStop("C"sv)).empty());
+
+  const BusId bus = *snapshot.FindBus("2"sv);
+  const transport::Snapshot::BusStats& stats = snapshot.GetBusStats(bus);
+  assert(stats.stop_count == 3 && stats.unique_stop_count == 2);
+  assert(stats.route_length == 2000);
+  assert(snapshot.BusStops(bus).size() == 3);
+  assert(snapshot.StopsByName().front() == a);
+
+  // Индекс имён находит каждое из многих имён и не находит чужие
+  // Имена из пула не перемещаются при его росте
+  transport::NamePool pool;
+  std::vector<std::string_view> names;
+  for (int i = 0; i < 20000; ++i) {
+    names.push_back(pool.Add("Stop "s + std::to_string(i)));
+  }
+  names.push_back(pool.Add("Stop 7"s));
+  const std::string long_name(100000, 'x');
+  assert(pool.Add(long_name) == long_name && names[0] == "Stop 0"s);
+  const transport::NameIndex::Table table = transport::NameIndex::Build(names);
+  const transport::NameIndex index(table.seed, table.displacements, table.slots);
+  for (uint32_t i = 0; i < 20000; ++i) {
+    assert(index.Find(names[i], names) == i);
+  }
+  assert(index.Find("Stop 7"sv, names) == 7u);
+  assert(!index.Find("Stop 20000"sv, names));
+}
+
+void Test_23() {
+  // Маршрут и расстояние приходят раньше своих остановок
+  Catalogue tc;
+  tc.AddRoute("1"s, {"A"s, "B"s, "A"s});
+  tc.SetDistance("A"sv, "B"sv, 400);
+  tc.SetDistance("B"sv, "Unknown"sv, 1);
+  tc.AddStop("B"sv, Coordinates{55.0, 37.0});
+  tc.AddRoute("0"s, {"B"s});
+  tc.AddStop("A"sv, Coordinates{55.1, 37.1});
+  assert(tc.GetBusData("1"s)->stops.empty());
+  tc.Finalize();
+
+  const Bus* bus = tc.GetBusData("1"s);
+  assert(bus->stopsOnRoute == 3 && bus->uniqueStops == 2);
+  assert(bus->routeLength == 800);
+  const Stop* stop = tc.GetStopData("B"s);
+  assert(stop->buses.size() == 2);
+  assert(tc.GetBus(stop->buses[0]).name == "0"s);
+  assert(tc.GetBus(stop->buses[1]).name == "1"s);
+
+  // Повторный Finalize не дублирует маршруты у остановок
+  tc.AddRoute("2"s, {"A"s});
+  tc.Finalize();
+  assert(tc.GetStopData("A"s)->buses.size() == 2);
+  assert(tc.GetStopData("B"s)->buses.size() == 2);
+
+  tc.AddRoute("3"s, {"A"s, "Nowhere"s});
+  try {
+    tc.Finalize();
+    assert(false);
+  } catch (const std::invalid_argument&) {
+  }
+}
+
+void Test_24() {
+  // Статистика, посчитанная в несколько потоков, совпадает с однопоточной
+  Catalogue serial;
+  Catalogue parallel;
+  for (Catalogue* tc : {&serial, &parallel}) {
+    for (int i = 0; i < 100; ++i) {
+      tc->AddStop(std::to_string(i), Coordinates{55.0 + i * 0.001, 37.0 + (i % 7) * 0.01});
+      tc->SetDistance(std::to_string(i), std::to_string((i + 1) % 100), 100 + i);
+    }
+    for (int bus = 0; bus < 3000; ++bus) {
+      std::vector<std::string> stops;
+      for (int i = 0; i < 2 + bus % 17; ++i) {
+        stops.push_back(std::to_string((bus * 7 + i * (1 + bus % 3)) % 100));
+      }
+      tc->AddRoute(std::to_string(bus), move(stops));
+    }
+  }
+  serial.Finalize(1);
+  parallel.Finalize(4);
+  for (BusId id = 0; id < 3000; ++id) {
+    const Bus& lhs = serial.GetBus(id);
+    const Bus& rhs = parallel.GetBus(id);
+    assert(lhs.routeLength == rhs.routeLength && lhs.curvature == rhs.curvature);
+    assert(lhs.stopsOnRoute == rhs.stopsOnRoute && lhs.uniqueStops == rhs.uniqueStops);
+  }
+  assert(serial.GetStop(0).buses == parallel.GetStop(0).buses);
+}
+
+void Test_25() {
+  // Длина пути пачками в точности равна сумме попарных расстояний
+  std::vector<Coordinates> coords;
+  std::vector<GeoPoint> points;
+  for (int i = 0; i < 50; ++i) {
+    coords.emplace_back(43.5 + i * 0.0137, 39.7 + (i * 31 % 50) * 0.0041);
+    points.emplace_back(coords.back());
+  }
+  std::vector<uint32_t> path;
+  for (uint32_t i = 0; i < 200; ++i) {
+    path.push_back(i * 17 % 50);
+  }
+  for (size_t count : {0, 1, 2, 64, 65, 200}) {
+    double expected = 0;
+    for (size_t i = 1; i < count; ++i) {
+      expected += ComputeDistance(coords[path[i - 1]], coords[path[i]]);
+    }
+    assert(ComputePathLength(points.data(), path.data(), count) == expected);
+  }
+}
+
+void Test_26() {
+  // Некольцевой маршрут хранится в одну сторону, а проходится в обе
+  Catalogue tc;
+  tc.AddStop("A"sv, Coordinates{55.0, 37.0});
+  tc.AddStop("B"sv, Coordinates{55.1, 37.1});
+  tc.AddStop("C"sv, Coordinates{55.2, 37.2});
+  tc.SetDistance("A"sv, "B"sv, 100);
+  tc.SetDistance("B"sv, "C"sv, 200);
+  tc.SetDistance("C"sv, "B"sv, 300);
+  tc.AddRoute("1"s, {"A"s, "B"s, "C"s}, false);
+  tc.AddRoute("2"s, {}, false);
+  tc.Finalize();
+
+  const Bus& bus = *tc.GetBusData("1"s);
+  assert(bus.stops.size() == 3);
+  assert(bus.stopsOnRoute == 5 && bus.uniqueStops == 3);
+  assert(bus.routeLength == 700);
+  const std::vector<StopId> expected = {0, 1, 2, 1, 0};
+  const RouteView route = bus.Route();
+  assert(std::vector<StopId>(route.begin(), route.end()) == expected);
+  assert(route.back() == 0 && route[route.ForwardSize() - 1] == 2);
+  assert(tc.GetBusData("2"s)->Route().empty());
+}
+
+void Test_27() {
+  // Ответы по сохранённой базе совпадают с ответами по исходному запросу.
+  // Запросы собираются в CBOR, чтобы координаты не теряли точность
+  const std::string base_file =
+      (std::filesystem::temp_directory_path() / "transport_test_base.bin"s).string();
+  const json::Document input = json::LoadFile("inout/test_11_input.json"s);
+  const json::Dict& sections = input.GetRoot().AsDict();
+  auto serialization = [&base_file]() {
+    return json::Builder{}.StartDict().Key("file"s).Value(base_file).EndDict().Build();
+  };
+
+  std::ostringstream make_base;
+  json::PrintBinary(json::Document{json::Builder{}
+                                       .StartDict()
+                                       .Key("base_requests"s)
+                                       .Value(json::Node{sections.at("base_requests"s)})
+                                       .Key("render_settings"s)
+                                       .Value(json::Node{sections.at("render_settings"s)})
+                                       .Key("serialization_settings"s)
+                                       .Value(serialization())
+                                       .EndDict()
+                                       .Build()},
+                    make_base);
+  {
+    Catalogue tc;
+    renderer::MapRenderer renderer;
+    RequestHandler handler(tc, renderer);
+    JsonReader reader(handler, make_base.str());
+    reader.SaveBase();
+  }
+
+  std::ostringstream process_requests;
+  json::PrintBinary(json::Document{json::Builder{}
+                                       .StartDict()
+                                       .Key("serialization_settings"s)
+                                       .Value(serialization())
+                                       .Key("stat_requests"s)
+                                       .Value(json::Node{sections.at("stat_requests"s)})
+                                       .EndDict()
+                                       .Build()},
+                    process_requests);
+  Catalogue tc;
+  renderer::MapRenderer renderer;
+  RequestHandler handler(tc, renderer);
+  JsonReader reader(handler, process_requests.str());
+  reader.LoadBase();
+  std::ostringstream out;
+  reader.Print(out);
+  assert(json::Load(out.str()) == json::LoadFile("inout/test_11_expect.json"s));
+
+  // Обрезанный файл не загружается
+  std::string image;
+  {
+    std::ifstream base(base_file, std::ios::binary);
+    image.assign(std::istreambuf_iterator<char>(base), {});
+  }
+  {
+    std::ofstream base(base_file, std::ios::binary | std::ios::trunc);
+    base.write(image.data(), image.size() / 2);
+  }
+  bool thrown = false;
+  try {
+    Snapshot::Load(base_file);
+  } catch (const std::runtime_error&) {
+    thrown = true;
+  }
+  assert(thrown);
+
+  // Испорченный файл тоже
+  std::mt19937 random(11);
+  for (int trial = 0; trial < 50; ++trial) {
+    std::string damaged = image;
+    for (int i = 0; i < 4; ++i) {
+      damaged[random() % damaged.size()] ^= static_cast<char>(1 + random() % 255);
+    }
+    {
+      std::ofstream base(base_file, std::ios::binary | std::ios::trunc);
+      base.write(damaged.data(), damaged.size());
+    }
+    thrown = false;
+    try {
+      Snapshot::Load(base_file);
+    } catch (const std::runtime_error&) {
+      thrown = true;
+    }
+    assert(thrown);
+  }
+  std::filesystem::remove(base_file);
+
+  // В недоступный файл база не сохраняется молча
+  const std::string missing_dir =
+      (std::filesystem::temp_directory_path() / "transport_test_missing"s / "base.bin"s).string();
+  std::ostringstream bad_base;
+  json::PrintBinary(json::Document{json::Builder{}
+                                       .StartDict()
+                                       .Key("base_requests"s)
+                                       .Value(json::Node{sections.at("base_requests"s)})
+                                       .Key("serialization_settings"s)
+                                       .Value(json::Builder{}.StartDict().Key("file"s).Value(missing_dir).EndDict().Build())
+                                       .EndDict()
+                                       .Build()},
+                    bad_base);
+  Catalogue bad_tc;
+  RequestHandler bad_handler(bad_tc, renderer);
+  JsonReader bad_reader(bad_handler, bad_base.str());
+  thrown = false;
+  try {
+    bad_reader.SaveBase();
+  } catch (const std::runtime_error&) {
+    thrown = true;
+  }
+  assert(thrown);
+}
+
+void Test_28() {
+  // Каталог после изменений совпадает с построенным заново
+  Catalogue changed;
+  changed.AddStop("A"sv, Coordinates{55.0, 37.0});
+  changed.AddStop("B"sv, Coordinates{55.1, 37.1});
+  changed.AddStop("C"sv, Coordinates{55.2, 37.0});
+  changed.AddStop("D"sv, Coordinates{55.3, 37.1});
+  changed.AddStop("E"sv, Coordinates{55.4, 37.0});
+  changed.SetDistance("A"sv, "B"sv, 1000);
+  changed.SetDistance("B"sv, "C"sv, 1100);
+  changed.SetDistance("C"sv, "D"sv, 1200);
+  changed.SetDistance("D"sv, "E"sv, 1300);
+  changed.SetDistance("E"sv, "C"sv, 1400);
+  changed.SetDistance("A"sv, "D"sv, 1500);
+  changed.AddRoute("1"s, {"A"s, "B"s, "C"s}, false);
+  changed.AddRoute("2"s, {"C"s, "D"s, "E"s, "C"s});
+  changed.AddRoute("3"s, {"A"s, "E"s, "D"s}, false);
+  changed.Finalize();
+
+  changed.UpdateStop("B"sv, Coordinates{55.15, 37.2});
+  changed.UpdateDistance("C"sv, "D"sv, 700);
+  changed.RemoveStop("E"sv);
+  changed.UpdateRoute("3"sv, {"A"s, "D"s}, false);
+  changed.RemoveRoute("1"sv);
+  changed.AddRoute("4"s, {"B"s, "C"s});
+  changed.Finalize();
+
+  Catalogue rebuilt;
+  rebuilt.AddStop("A"sv, Coordinates{55.0, 37.0});
+  rebuilt.AddStop("B"sv, Coordinates{55.15, 37.2});
+  rebuilt.AddStop("C"sv, Coordinates{55.2, 37.0});
+  rebuilt.AddStop("D"sv, Coordinates{55.3, 37.1});
+  rebuilt.SetDistance("A"sv, "B"sv, 1000);
+  rebuilt.SetDistance("B"sv, "C"sv, 1100);
+  rebuilt.SetDistance("C"sv, "D"sv, 700);
+  rebuilt.SetDistance("A"sv, "D"sv, 1500);
+  rebuilt.AddRoute("2"s, {"C"s, "D"s, "C"s});
+  rebuilt.AddRoute("3"s, {"A"s, "D"s}, false);
+  rebuilt.AddRoute("4"s, {"B"s, "C"s});
+  rebuilt.Finalize();
+
+  for (const std::string& number : {"2"s, "3"s, "4"s}) {
+    const Bus& lhs = *changed.GetBusData(number);
+    const Bus& rhs = *rebuilt.GetBusData(number);
+    assert(lhs.routeLength == rhs.routeLength && lhs.curvature == rhs.curvature);
+    assert(lhs.stopsOnRoute == rhs.stopsOnRoute && lhs.uniqueStops == rhs.uniqueStops);
+  }
+  for (const std::string& name : {"A"s, "B"s, "C"s, "D"s}) {
+    const std::vector<BusId>& lhs = changed.GetStopData(name)->buses;
+    const std::vector<BusId>& rhs = rebuilt.GetStopData(name)->buses;
+    assert(lhs.size() == rhs.size());
+    for (size_t i = 0; i < lhs.size(); ++i) {
+      assert(changed.GetBus(lhs[i]).name == rebuilt.GetBus(rhs[i]).name);
+    }
+  }
+  assert(!changed.GetBusData("1"s) && !changed.GetStopData("E"s));
+
+  // Удалённые не видны в снимке, а имя можно занять заново
+  changed.AddStop("E"sv, Coordinates{55.5, 37.5});
+  const std::shared_ptr<const Snapshot> snapshot = changed.Freeze();
+  assert(!snapshot->FindBus("1"sv) && snapshot->BusesByName().size() == 3);
+  assert(snapshot->FindStop("E"sv) == StopId(5) && snapshot->StopsByName().size() == 5);
+
+  bool thrown = false;
+  try {
+    changed.UpdateStop("Nowhere"sv, Coordinates{});
+  } catch (const std::invalid_argument&) {
+    thrown = true;
+  }
+  assert(thrown);
+
+  // Кольцо без конечной замыкается на следующую остановку, а маршрут
+  // из одной остановки удаляется
+  Catalogue shrunk;
+  shrunk.AddStop("A"sv, Coordinates{55.0, 37.0});
+  shrunk.AddStop("B"sv, Coordinates{55.1, 37.1});
+  shrunk.AddStop("C"sv, Coordinates{55.2, 37.0});
+  shrunk.SetDistance("A"sv, "B"sv, 1000);
+  shrunk.SetDistance("B"sv, "C"sv, 1100);
+  shrunk.SetDistance("C"sv, "A"sv, 1200);
+  shrunk.AddRoute("ring"s, {"A"s, "B"s, "C"s, "A"s});
+  shrunk.AddRoute("line"s, {"A"s, "B"s}, false);
+  shrunk.AddRoute("back"s, {"B"s, "A"s, "B"s});
+  shrunk.Finalize();
+  shrunk.RemoveStop("A"sv);
+  shrunk.Finalize();
+  assert(!shrunk.GetBusData("line"s) && !shrunk.GetBusData("back"s));
+  const Bus& ring = *shrunk.GetBusData("ring"s);
+  assert((ring.stops == std::vector<StopId>{1, 2, 1}));
+  assert(ring.routeLength == 2200 && ring.stopsOnRoute == 3 && ring.uniqueStops == 2);
+  assert(!std::isnan(ring.curvature));
+  assert(shrunk.GetStopData("B"s)->buses.size() == 1);
+  assert(shrunk.Freeze()->BusesByName().size() == 1);
+}
+
+void Test_29() {
+  // Версия снимка с номером version: широта остановки равна номеру,
+  // а расстояние между остановками на 100 больше
+  auto make_version = [](int version) {
+    Catalogue tc;
+    tc.AddStop("A"sv, Coordinates{double(version), 0.0});
+    tc.AddStop("B"sv, Coordinates{0.0, 0.0});
+    tc.SetDistance("A"sv, "B"sv, version + 100);
+    tc.AddRoute("1"s, {"A"s, "B"s}, false);
+    return tc.Freeze();
+  };
+
+  SnapshotVersions versions(4);
+  std::shared_ptr<const Snapshot> first = make_version(0);
+  std::weak_ptr<const Snapshot> first_alive = first;
+  versions.Publish(move(first));
+
+  // Закреплённая версия переживает публикации новых
+  const size_t reader = versions.RegisterReader();
+  {
+    const SnapshotVersions::Pin pin = versions.Acquire(reader);
+    versions.Publish(make_version(1));
+    versions.Publish(make_version(2));
+    assert(versions.Reclaim() == 2 && !first_alive.expired());
+    assert(pin->StopCoordinates(*pin->FindStop("A"sv)).lat == 0.0);
+  }
+  assert(versions.Reclaim() == 0 && first_alive.expired());
+  assert(versions.Current()->StopCoordinates(0).lat == 2.0);
+
+  // Читатели во время обновлений видят только целые версии
+  const int version_count = 200;
+  std::atomic<bool> done = false;
+  std::atomic<int> reads = 0;
+  auto read = [&versions, &done, &reads] {
+    const size_t reader = versions.RegisterReader();
+    int last_version = 0;
+    while (!done.load()) {
+      const SnapshotVersions::Pin pin = versions.Acquire(reader);
+      const int version = int(pin->StopCoordinates(*pin->FindStop("A"sv)).lat);
+      const BusId bus = *pin->FindBus("1"sv);
+      assert(pin->GetBusStats(bus).route_length == 2 * (version + 100));
+      assert(version >= last_version);
+      last_version = version;
+      ++reads;
+    }
+    versions.UnregisterReader(reader);
+  };
+  std::thread first_reader(read);
+  std::thread second_reader(read);
+  for (int version = 3; version < version_count; ++version) {
+    versions.Publish(make_version(version));
+    std::this_thread::yield();
+  }
+  done = true;
+  first_reader.join();
+  second_reader.join();
+  assert(reads.load() > 0);
+  assert(versions.Reclaim() == 0);
+  assert(versions.Current()->StopCoordinates(0).lat == version_count - 1);
+
+  // Слоты ушедших читателей достаются новым
+  for (int i = 0; i < 10; ++i) {
+    std::thread short_reader([&versions] {
+      const size_t reader = versions.RegisterReader();
+      assert(versions.Acquire(reader)->FindStop("A"sv));
+      versions.UnregisterReader(reader);
+    });
+    short_reader.join();
+  }
+
+  // Все четыре слота заняты
+  for (int i = 0; i < 3; ++i) {
+    versions.RegisterReader();
+  }
+  bool thrown = false;
+  try {
+    versions.RegisterReader();
+  } catch (const std::length_error&) {
+    thrown = true;
+  }
+  assert(thrown);
+  versions.UnregisterReader(reader);
+  assert(versions.RegisterReader() == reader);
+}
+
+void Test_30() {
+  // Индекс отвечает так же, как полный перебор, в том числе
+  // у полюсов и 180-го меридиана
+  Catalogue tc;
+  std::vector<Coordinates> coords;
+  uint64_t state = 1;
+  auto next = [&state](double range) {
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return double(state >> 11) / double(1ULL << 53) * range;
+  };
+  for (int i = 0; i < 3000; ++i) {
+    coords.emplace_back(next(180.0) - 90.0, next(360.0) - 180.0);
+    tc.AddStop(std::to_string(i), coords.back());
+  }
+  tc.RemoveStop("0"sv);
+  const std::shared_ptr<const Snapshot> snapshot = tc.Freeze();
+
+  const std::vector<Coordinates> queries = {
+      Coordinates{55.7, 37.6}, Coordinates{89.9, 10.0},
+      Coordinates{-10.0, 179.9}, Coordinates{0.0, -180.0}};
+  for (const Coordinates& from : queries) {
+    std::vector<double> expected;
+    for (size_t i = 1; i < coords.size(); ++i) {
+      expected.push_back(ComputeDistance(from, coords[i]));
+    }
+    sort(expected.begin(), expected.end());
+    const auto nearest = snapshot->NearestStops(from, 10);
+    assert(nearest.size() == 10);
+    for (size_t i = 0; i < nearest.size(); ++i) {
+      assert(nearest[i].id != 0);
+      assert(abs(nearest[i].distance - expected[i]) < 1e-3);
+    }
+  }
+  const auto same_place = snapshot->NearestStops(coords[1], 1);
+  assert(same_place.front().id == 1 && same_place.front().distance == 0.0);
+  assert(snapshot->NearestStops(Coordinates{}, 5000).size() ==
+         coords.size() - 1);
+  assert(snapshot->NearestStops(Coordinates{}, 0).empty());
+
+  auto in_box = [&coords](Coordinates min, Coordinates max) {
+    std::vector<StopId> result;
+    for (StopId id = 1; id < coords.size(); ++id) {
+      const Coordinates& coord = coords[id];
+      const bool lng_inside = min.lng <= max.lng
+                                  ? min.lng <= coord.lng && coord.lng <= max.lng
+                                  : min.lng <= coord.lng || coord.lng <= max.lng;
+      if (min.lat <= coord.lat && coord.lat <= max.lat && lng_inside) {
+        result.push_back(id);
+      }
+    }
+    return result;
+  };
+  for (const auto& [min, max] :
+       {std::pair{Coordinates{-20.0, -30.0}, Coordinates{40.0, 50.0}},
+        std::pair{Coordinates{-60.0, 170.0}, Coordinates{60.0, -170.0}},
+        std::pair{Coordinates{10.0, 0.0}, Coordinates{-10.0, 1.0}}}) {
+    std::vector<StopId> found = snapshot->StopsInBox(min, max);
+    sort(found.begin(), found.end());
+    assert(found == in_box(min, max));
+  }
+
+  // Запросы статистики
+  Catalogue json_tc;
+  renderer::MapRenderer renderer;
+  RequestHandler handler(json_tc, renderer);
+  JsonReader reader(handler, R"({
+    "base_requests": [
+      {"type": "Stop", "name": "A", "latitude": 0.0, "longitude": 0.0,
+       "road_distances": {}},
+      {"type": "Stop", "name": "B", "latitude": 0.0, "longitude": 1.0,
+       "road_distances": {}},
+      {"type": "Stop", "name": "C", "latitude": 10.0, "longitude": 10.0,
+       "road_distances": {}}
+    ],
+    "stat_requests": [
+      {"id": 1, "type": "NearestStops", "latitude": 0.0, "longitude": 0.9,
+       "count": 2},
+      {"id": 2, "type": "StopsInBox", "min_latitude": -1.0,
+       "min_longitude": -1.0, "max_latitude": 1.0, "max_longitude": 2.0}
+    ]
+  })"sv);
+  std::ostringstream out;
+  reader.Print(out);
+  const std::string result = out.str();
+  const size_t nearest = result.find(R"("request_id": 1)");
+  assert(nearest != std::string::npos);
+  assert(result.find(R"("name": "B")", nearest) <
+         result.find(R"("name": "A")", nearest));
+  assert(result.find(R"("name": "C")") == std::string::npos);
+  assert(result.find(R"("stops": [)") != std::string::npos);
+  assert(result.find(R"("A",)") != std::string::npos);
+}
+
+void Test_31() {
+  // Пути по иерархии сжатий совпадают с Дейкстрой по исходному графу
+  Catalogue tc;
+  const int stop_count = 400;
+  uint64_t state = 7;
+  auto next = [&state](uint64_t range) {
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (state >> 33) % range;
+  };
+  for (int i = 0; i < stop_count; ++i) {
+    tc.AddStop(std::to_string(i), Coordinates{55.0 + next(1000) * 1e-4,
+                                              37.0 + next(1000) * 1e-4});
+  }
+  // Последняя остановка ни с чем не связана
+  std::vector<std::pair<StopId, StopId>> roads;
+  for (int i = 0; i < stop_count * 3; ++i) {
+    const StopId from = next(stop_count - 1);
+    const StopId to = next(stop_count - 1);
+    tc.SetDistance(std::to_string(from), std::to_string(to), 1 + next(1000));
+    roads.push_back({from, to});
+  }
+  const std::shared_ptr<const Snapshot> snapshot = tc.Freeze();
+
+  std::vector<std::vector<std::pair<StopId, uint32_t>>> graph(stop_count);
+  for (const auto& [from, to] : roads) {
+    for (const auto& [lhs, rhs] : {std::pair{from, to}, std::pair{to, from}}) {
+      if (lhs != rhs) {
+        graph[lhs].push_back({rhs, snapshot->GetDistance(lhs, rhs)});
+      }
+    }
+  }
+  auto dijkstra = [&graph](StopId from) {
+    std::vector<uint64_t> distances(graph.size(), UINT64_MAX);
+    std::set<std::pair<uint64_t, StopId>> queue{{0, from}};
+    distances[from] = 0;
+    while (!queue.empty()) {
+      const auto [distance, stop] = *queue.begin();
+      queue.erase(queue.begin());
+      for (const auto& [to, length] : graph[stop]) {
+        if (distance + length < distances[to]) {
+          queue.erase({distances[to], to});
+          distances[to] = distance + length;
+          queue.insert({distances[to], to});
+        }
+      }
+    }
+    return distances;
+  };
+
+  // Freeze иерархию не строит, она сохраняется в файл вместе со снимком
+  assert(snapshot->GetRoadHierarchy().empty());
+  const std::string base_file =
+      (std::filesystem::temp_directory_path() / "transport_test_roads.bin"s).string();
+  {
+    const Snapshot::Hierarchy hierarchy = ContractRoads(*snapshot);
+    std::ofstream output(base_file, std::ios::binary);
+    snapshot->Save(output, "settings"sv, &hierarchy);
+  }
+  const std::shared_ptr<const Snapshot> loaded = Snapshot::Load(base_file);
+  std::filesystem::remove(base_file);
+  assert(!loaded->GetRoadHierarchy().empty() && loaded->Settings() == "settings"sv);
+
+  RoadRouter router(*snapshot);
+  RoadRouter loaded_router(*loaded);
+  for (int i = 0; i < 20; ++i) {
+    const StopId from = next(stop_count);
+    const std::vector<uint64_t> expected = dijkstra(from);
+    for (StopId to = 0; to < stop_count; ++to) {
+      const auto route = router.FindRoute(from, to);
+      const auto loaded_route = loaded_router.FindRoute(from, to);
+      assert(route.has_value() == loaded_route.has_value());
+      assert(!route || route->stops == loaded_route->stops);
+      if (expected[to] == UINT64_MAX) {
+        assert(!route);
+        continue;
+      }
+      assert(route && route->distance == expected[to]);
+      assert(route->stops.front() == from && route->stops.back() == to);
+      uint64_t length = 0;
+      for (size_t j = 1; j < route->stops.size(); ++j) {
+        const uint32_t road =
+            snapshot->GetDistance(route->stops[j - 1], route->stops[j]);
+        assert(road != 0);
+        length += road;
+      }
+      assert(length == route->distance);
+    }
+  }
+
+  // Длина цепочки срезок не помещается в 32 бита
+  Catalogue chain_tc;
+  for (int i = 0; i < 6; ++i) {
+    chain_tc.AddStop(std::to_string(i), Coordinates{55.0 + i * 0.01, 37.0});
+  }
+  for (int i = 0; i + 1 < 6; ++i) {
+    chain_tc.SetDistance(std::to_string(i), std::to_string(i + 1), 4000000000u);
+  }
+  const std::shared_ptr<const Snapshot> chain = chain_tc.Freeze();
+  RoadRouter chain_router(*chain);
+  const auto long_route = chain_router.FindRoute(0, 5);
+  assert(long_route && long_route->distance == 20000000000ull);
+  assert(long_route->stops.size() == 6);
+
+  // Запрос статистики
+  Catalogue json_tc;
+  renderer::MapRenderer renderer;
+  RequestHandler handler(json_tc, renderer);
+  JsonReader reader(handler, R"({
+    "base_requests": [
+      {"type": "Stop", "name": "A", "latitude": 55.0, "longitude": 37.0,
+       "road_distances": {"B": 1000000, "C": 2000000}},
+      {"type": "Stop", "name": "B", "latitude": 55.1, "longitude": 37.0,
+       "road_distances": {"C": 234567}},
+      {"type": "Stop", "name": "C", "latitude": 55.2, "longitude": 37.0,
+       "road_distances": {}},
+      {"type": "Stop", "name": "D", "latitude": 55.3, "longitude": 37.0,
+       "road_distances": {}}
+    ],
+    "stat_requests": [
+      {"id": 1, "type": "Distance", "from": "A", "to": "C"},
+      {"id": 2, "type": "Distance", "from": "A", "to": "D"}
+    ]
+  })"sv);
+  std::ostringstream out;
+  reader.Print(out);
+  const std::string result = out.str();
+  // Метры печатаются целым числом без потери цифр
+  assert(result.find(R"("distance": 1234567,)") != std::string::npos);
+  assert(result.find(R"("A",)") < result.find(R"("B",)"));
+  assert(result.find(R"("B",)") < result.find(R"("C")"));
+  assert(result.find(R"("error_message": "not found")") != std::string::npos);
+}
+
 }  // namespace tests
 }  // namespace transport